@@ -0,0 +1,202 @@
+#include <vxWorks.h>
+#include <ioLib.h>
+#include <sysLib.h>
+#include <taskLib.h>
+#include <tickLib.h>
+#include <algorithm>
+#include <stdexcept>
+#include "./vwpp_acquisition.h"
+#include "./vwpp_time.h"
+
+using namespace vwpp::v3_0;
+using namespace vwpp::v3_0::VME;
+
+namespace {
+
+    struct FileHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t columns;
+	uint32_t rowBytes;
+    };
+}
+
+// The ring needs at least two entries: while the writer fills in a
+// sample, the entry it's replacing can't be read.
+
+AcquisitionBase::AcquisitionBase(uint64_t* const s, size_t const n) :
+    stamps(s), depth(n), head(0), claimed(0), origin(0)
+{
+    if (UNLIKELY(n < 2))
+	throw std::out_of_range("acquisition needs at least two samples");
+}
+
+uint32_t AcquisitionBase::oldest(uint32_t const h) const NOTHROW_IMPL
+{
+    return h > depth - 1 ? h - (depth - 1) : 0;
+}
+
+// 'claimed' tells readers which entry is being overwritten, so it
+// has to be visible before the entry changes. The first sample
+// calibrates the time base, which takes a few clock ticks.
+
+uint32_t AcquisitionBase::begin()
+{
+    uint64_t const now = read_timebase64();
+    uint32_t const seq = head.load(Relaxed);
+
+    if (UNLIKELY(!seq))
+	origin = now;
+    claimed.store(seq + 1, Relaxed);
+    atomic_fence(Release);
+    stamps[seq % depth] = counts_to_us(now - origin);
+    return seq;
+}
+
+void AcquisitionBase::commit() NOTHROW_IMPL
+{
+    head.store(claimed.load(Relaxed), Release);
+}
+
+SampleRange AcquisitionBase::latest(uint32_t const n) const NOTHROW_IMPL
+{
+    uint32_t const h = head.load(Acquire);
+    uint32_t const avail = h - oldest(h);
+    uint32_t const count = n < avail ? n : avail;
+    SampleRange const r = { h - count, count };
+
+    return r;
+}
+
+// The time stamps increase with the sequence number, so both ends
+// of the range are found with a binary search.
+
+SampleRange AcquisitionBase::find(uint64_t const from,
+				  uint64_t const to) const NOTHROW_IMPL
+{
+    uint32_t const h = head.load(Acquire);
+    uint32_t lo = oldest(h);
+    uint32_t hi = h;
+
+    while (lo < hi) {
+	uint32_t const mid = lo + (hi - lo) / 2;
+
+	if (time(mid) < from)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    uint32_t const first = lo;
+
+    hi = h;
+    while (lo < hi) {
+	uint32_t const mid = lo + (hi - lo) / 2;
+
+	if (time(mid) < to)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    SampleRange const r = { first, lo - first };
+
+    return r;
+}
+
+// Sample 'seq' is lost once the writer claims sample 'seq + depth'.
+
+bool AcquisitionBase::intact(SampleRange const& r) const NOTHROW_IMPL
+{
+    atomic_fence(Acquire);
+    return claimed.load(Relaxed) - r.first <= depth;
+}
+
+Status AcquisitionBase::_write(int const fd, void const* const buf,
+			       size_t const len) NOTHROW_IMPL
+{
+    char* ptr = static_cast<char*>(const_cast<void*>(buf));
+    size_t left = len;
+
+    while (left) {
+	int const n = ::write(fd, ptr, left);
+
+	if (n <= 0)
+	    return Failure;
+	ptr += n;
+	left -= n;
+    }
+    return Success;
+}
+
+// The header is written in the target's byte order; a reader can
+// tell which one it is from the magic number.
+
+Status AcquisitionBase::_writeHeader(int const fd, ColumnInfo const* const info,
+				     size_t const n,
+				     size_t const rowBytes) const NOTHROW_IMPL
+{
+    FileHeader const hdr = {
+	FileMagic, FileVersion, static_cast<uint16_t>(n),
+	static_cast<uint32_t>(rowBytes)
+    };
+    Status const s = _write(fd, &hdr, sizeof(hdr));
+
+    return Success == s ? _write(fd, info, n * sizeof(*info)) : s;
+}
+
+void Sampler::start(char const* const name, int const period,
+		    unsigned char const pri, int const stack)
+{
+    ticks = std::max(ms_to_tick(period), 1);
+    overrunCount = 0;
+    jitterUs = 0;
+    run(name, pri, stack);
+}
+
+// The jitter is only measured between consecutive cycles; an
+// overrun restarts the measurement.
+
+void Sampler::taskEntry()
+{
+    // Calibrate the time base before the first cycle.
+
+    timebase_hz();
+
+    int32_t const periodUs =
+	static_cast<int32_t>(ticks * 1000000ull / ::sysClkRateGet());
+    unsigned long next = ::tickGet();
+    uint32_t last = 0;
+    bool measure = false;
+
+    while (true) {
+	next += ticks;
+
+	long wait = static_cast<long>(next - ::tickGet());
+
+	if (wait < 0) {
+	    unsigned long const missed = (-wait + ticks - 1) / ticks;
+
+	    overrunCount += missed;
+	    next += missed * ticks;
+	    wait = static_cast<long>(next - ::tickGet());
+	    measure = false;
+	}
+	if (wait > 0)
+	    ::taskDelay(wait);
+
+	uint32_t const now = read_timebase();
+
+	if (measure) {
+	    int32_t const diff =
+		static_cast<int32_t>(counts_to_us(now - last)) - periodUs;
+	    uint32_t const jitter = diff < 0 ? -diff : diff;
+
+	    if (jitter > jitterUs)
+		jitterUs = jitter;
+	}
+	last = now;
+	measure = true;
+	sample();
+    }
+}
@@ -0,0 +1,147 @@
+#include <vxWorks.h>
+#include "./vwpp_coro.h"
+
+// vwpp_coro.h is all inline, so this module only holds its test.
+// Like the header, it's empty unless it's compiled as C++20.
+
+#if __cplusplus >= 202002L && !defined(NDEBUG)
+
+#include <taskLib.h>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+using namespace vwpp::v3_0;
+
+extern "C" {
+    STATUS vwppTestCoro();
+}
+
+namespace {
+
+    void check(bool const cond, char const* const what)
+    {
+	if (UNLIKELY(!cond))
+	    throw std::runtime_error(what);
+    }
+
+    typedef Queue<uint32_t, 8> Channel;
+
+    // Held by the test task while the coroutines try to lock it.
+
+    Mutex shared;
+
+    // What the coroutines saw. Each one counts itself in 'done'
+    // when it finishes.
+
+    struct Results {
+	Atomic<uint32_t> done;
+	uint32_t sum;
+	Status drained;
+	Status woke;
+	Status locked;
+	Status lockTimedOut;
+
+	Results() :
+	    done(0), sum(0), drained(Success), woke(Timeout),
+	    locked(Timeout), lockTimedOut(Success)
+	{}
+    };
+
+    // g++ 12 misplaces the promise of a coroutine that has a
+    // co_await in an if statement's condition, so the results are
+    // stored first.
+
+    coro::Job consume(coro::SchedulerBase&, Channel& q, Results& r)
+    {
+	uint32_t v;
+
+	while (true) {
+	    Status const s = co_await coro::pop_front(q, v, 100);
+
+	    if (Success != s) {
+		r.drained = s;
+		break;
+	    }
+	    r.sum += v;
+	}
+	r.done.fetch_add(1, Release);
+    }
+
+    coro::Job waitFor(coro::SchedulerBase&, Event<TaskSignal>& ev,
+		      Results& r)
+    {
+	r.woke = co_await coro::wait(ev, 1000);
+	r.done.fetch_add(1, Release);
+    }
+
+    coro::Job lockShared(coro::SchedulerBase&, int const tmo,
+			 Status& result, Results& r)
+    {
+	{
+	    coro::MutexLock const lock = co_await coro::lock(shared, tmo);
+
+	    result = lock.status();
+	}
+	r.done.fetch_add(1, Release);
+    }
+}
+
+// Regression test for the coroutine scheduler and its awaitables.
+// Coroutines drain a queue, wait on an event and lock a Mutex held
+// by this task, one of them with a timeout shorter than the time
+// it's held. It must be run by a task.
+
+STATUS vwppTestCoro()
+{
+    try {
+	enum { Jobs = 4, Values = 20 };
+
+	coro::Scheduler<1024, 8> sched;
+	Channel q;
+	Event<TaskSignal> ev;
+	Results r;
+	int pri;
+
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	sched.run("tTestCoro", std::min(pri + 10, 255), 16384);
+
+	{
+	    Mutex::Lock<shared> held;
+
+	    check(consume(sched, q, r).valid() &&
+		  waitFor(sched, ev, r).valid() &&
+		  lockShared(sched, 30, r.lockTimedOut, r).valid() &&
+		  lockShared(sched, 1000, r.locked, r).valid(),
+		  "couldn't start the coroutines");
+
+	    for (uint32_t v = 1; v <= Values; ++v)
+		check(q.push_back(v, 1000), "the consumer stalled");
+	    ::taskDelay(ms_to_tick(100));
+	    ev.wakeOne();
+	}
+
+	for (int tick = 0; r.done.load(Acquire) < Jobs; ++tick) {
+	    check(tick < 1000, "the coroutines didn't finish");
+	    ::taskDelay(1);
+	}
+	check(Values * (Values + 1) / 2 == r.sum, "lost queue messages");
+	check(Timeout == r.drained, "the empty queue didn't time out");
+	check(Success == r.woke, "the event wasn't received");
+	check(Timeout == r.lockTimedOut, "locked a mutex held by a task");
+	check(Success == r.locked, "didn't get the released mutex");
+
+	for (int tick = 0; sched.frames(); ++tick) {
+	    check(tick < 1000, "coroutine frames weren't released");
+	    ::taskDelay(1);
+	}
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestCoro() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+#endif
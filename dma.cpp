@@ -0,0 +1,351 @@
+#include <vxWorks.h>
+#include <stdexcept>
+#include "./vwpp_dma.h"
+
+using namespace vwpp::v3_0;
+using namespace vwpp::v3_0::VME;
+
+// The engine may complete requests at interrupt level, so the
+// request states and the Dma queues are guarded by IntLock.
+
+void DmaRequest::setSegments(DmaSegment const* const s, size_t const n)
+{
+    IntLock lock;
+
+    if (UNLIKELY(isBusy()))
+	throw std::logic_error("DMA request is still in progress");
+    segs = s;
+    nSegs = n;
+}
+
+// A signal left over from an earlier transfer can wake us early,
+// so the state is checked again after each wake-up, and the next
+// wait only gets what's left of the timeout. Once none is left, the
+// event is polled, which reports an empty semaphore as Unavailable.
+
+Status DmaRequest::try_wait(int const tmo) NOTHROW_IMPL
+{
+    Deadline const dl(tmo);
+    IntLock lock;
+
+    while (isBusy()) {
+	Status const s = done.try_wait(lock, dl.remaining());
+
+	if (Success != s)
+	    return Unavailable == s ? Timeout : s;
+    }
+    return result;
+}
+
+bool DmaRequest::wait(int const tmo)
+{
+    switch (try_wait(tmo)) {
+     case Success:
+	return true;
+
+     case Timeout:
+	return false;
+
+     case NotIsrCallable:
+	throw std::logic_error("cannot wait for DMA in an interrupt handler");
+
+     default:
+	throw std::runtime_error("DMA transfer failed");
+    }
+}
+
+void DmaEngine::complete(DmaRequest& req, Status const s) NOTHROW_IMPL
+{
+    req.owner->finished(req, s);
+}
+
+void Dma::finished(DmaRequest& req, Status const s) NOTHROW_IMPL
+{
+    IntLock lock;
+
+    req.result = s;
+    req.state.store(DmaRequest::Idle, Release);
+    req.done.wakeOne();
+
+    if (DmaRequest* const nxt = head) {
+	if (!(head = nxt->next))
+	    tail = 0;
+	nxt->state.store(DmaRequest::Active, Relaxed);
+	engine.start(*nxt);
+    } else
+	--inFlight;
+}
+
+Status Dma::try_submit(DmaRequest& req) NOTHROW_IMPL
+{
+    if (UNLIKELY(!req.nSegs))
+	return BadLength;
+
+    IntLock lock;
+
+    if (UNLIKELY(req.isBusy()))
+	return Unavailable;
+
+    req.owner = this;
+    req.next = 0;
+    req.result = Success;
+
+    if (inFlight < engine.depth()) {
+	++inFlight;
+	req.state.store(DmaRequest::Active, Relaxed);
+	engine.start(req);
+    } else {
+	req.state.store(DmaRequest::Queued, Relaxed);
+	if (tail)
+	    tail->next = &req;
+	else
+	    head = &req;
+	tail = &req;
+    }
+    return Success;
+}
+
+void Dma::submit(DmaRequest& req)
+{
+    switch (try_submit(req)) {
+     case Success:
+	return;
+
+     case BadLength:
+	throw std::invalid_argument("DMA request has no segments");
+
+     default:
+	throw std::logic_error("DMA request is still in progress");
+    }
+}
+
+size_t Dma::outstanding() const NOTHROW_IMPL
+{
+    IntLock lock;
+    size_t total = inFlight;
+
+    for (DmaRequest const* ptr = head; ptr; ptr = ptr->next)
+	++total;
+    return total;
+}
+
+SoftDmaEngine::SoftDmaEngine(size_t const n) :
+    maxDepth(n), first(0), count(0), worker(*this)
+{
+    if (UNLIKELY(n < 1 || n > MaxDepth))
+	throw std::out_of_range("bad DMA engine depth");
+}
+
+SoftDmaEngine::~SoftDmaEngine() NOTHROW_IMPL
+{
+    worker.stop();
+}
+
+void SoftDmaEngine::run(char const* const name, unsigned char const pri,
+			int const stack)
+{
+    worker.run(name, pri, stack);
+}
+
+uint8_t volatile* SoftDmaEngine::translate(AddressSpace const space,
+					   uint32_t const addr)
+{
+    return calcBaseAddr(space, addr);
+}
+
+// Dma never starts more than 'maxDepth' requests, so the ring can't
+// overflow.
+
+void SoftDmaEngine::start(DmaRequest& req) NOTHROW_IMPL
+{
+    ring[(first + count++) % MaxDepth] = &req;
+    work.wakeOne();
+}
+
+Status SoftDmaEngine::copy(DmaRequest const& req)
+{
+    for (size_t ii = 0; ii < req.segmentCount(); ++ii) {
+	DmaSegment const& seg = req.segments()[ii];
+	uint8_t volatile* const vme = translate(seg.space, seg.addr);
+	uint8_t* const local = static_cast<uint8_t*>(seg.local);
+
+	if (((reinterpret_cast<size_t>(vme) |
+	      reinterpret_cast<size_t>(local) | seg.bytes) & 3) == 0) {
+	    uint32_t volatile* const v =
+		reinterpret_cast<uint32_t volatile*>(vme);
+	    uint32_t* const l = reinterpret_cast<uint32_t*>(local);
+	    size_t const words = seg.bytes / 4;
+
+	    if (FromVme == seg.dir)
+		for (size_t jj = 0; jj < words; ++jj)
+		    l[jj] = v[jj];
+	    else
+		for (size_t jj = 0; jj < words; ++jj)
+		    v[jj] = l[jj];
+	} else if (FromVme == seg.dir)
+	    for (size_t jj = 0; jj < seg.bytes; ++jj)
+		local[jj] = vme[jj];
+	else
+	    for (size_t jj = 0; jj < seg.bytes; ++jj)
+		vme[jj] = local[jj];
+    }
+
+    // The writes have to reach the device before the request is
+    // reported as done.
+
+    io_fence();
+    return Success;
+}
+
+void SoftDmaEngine::Worker::taskEntry()
+{
+    while (true) {
+	DmaRequest* req;
+
+	{
+	    IntLock lock;
+
+	    while (!engine.count)
+		engine.work.wait(lock);
+	    req = engine.ring[engine.first];
+	    engine.first = (engine.first + 1) % MaxDepth;
+	    --engine.count;
+	}
+
+	Status s;
+
+	try {
+	    s = engine.copy(*req);
+	}
+	catch (...) {
+	    s = Failure;
+	}
+	complete(*req, s);
+    }
+}
+
+#ifndef NDEBUG
+
+#include <taskLib.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+extern "C" {
+    STATUS vwppTestDma();
+}
+
+namespace {
+
+    void check(bool const cond, char const* const what)
+    {
+	if (UNLIKELY(!cond))
+	    throw std::runtime_error(what);
+    }
+
+    // A SoftDmaEngine whose "VME bus" is a local buffer, so
+    // transfers can be checked without a device.
+
+    class MemoryEngine : public SoftDmaEngine {
+	uint8_t volatile* translate(AddressSpace, uint32_t const addr)
+	{
+	    return bus + addr;
+	}
+
+     public:
+	enum { Size = 512 };
+
+	uint8_t volatile* const bus;
+
+	explicit MemoryEngine(uint8_t volatile* const b) :
+	    SoftDmaEngine(2), bus(b)
+	{}
+    };
+}
+
+// Regression test for Dma and SoftDmaEngine. Five requests are
+// queued on an engine of depth 2, so three of them wait in Dma's
+// queue. Each reads a block in 32-bit words and writes three bytes
+// back to an unaligned address. It must be run by a task.
+
+STATUS vwppTestDma()
+{
+    try {
+	enum { Requests = 5, Block = 64 };
+
+	uint32_t bus[MemoryEngine::Size / 4];
+	uint8_t volatile* const mem = reinterpret_cast<uint8_t*>(bus);
+	MemoryEngine engine(mem);
+	Dma dma(engine);
+	uint32_t in[Requests][Block / 4];
+	uint8_t out[Requests][3];
+	DmaSegment seg[Requests][2];
+	DmaRequest req[Requests];
+	DmaRequest empty;
+	int pri;
+
+	for (size_t ii = 0; ii < MemoryEngine::Size; ++ii)
+	    mem[ii] = static_cast<uint8_t>(ii * 7 + 1);
+	std::memset(in, 0, sizeof(in));
+
+	for (uint32_t ii = 0; ii < Requests; ++ii) {
+	    DmaSegment const rd = { A32, ii * Block, in[ii], Block,
+				    FromVme };
+	    DmaSegment const wr = { A32, Requests * Block + ii * 4 + 1,
+				    out[ii], sizeof(out[ii]), ToVme };
+
+	    std::memset(out[ii], 0xa0 + ii, sizeof(out[ii]));
+	    seg[ii][0] = rd;
+	    seg[ii][1] = wr;
+	    req[ii].setSegments(seg[ii], 2);
+	}
+
+	check(BadLength == dma.try_submit(empty),
+	      "submitted a request without segments");
+	check(Success == req[0].try_wait(0),
+	      "an idle request wasn't finished");
+
+	// The engine's task runs at a lower priority, so nothing
+	// is copied until this task blocks.
+
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	engine.run("tTestDma", std::min(pri + 10, 255), 8192);
+
+	for (size_t ii = 0; ii < Requests; ++ii)
+	    dma.submit(req[ii]);
+	check(Requests == dma.outstanding(), "wrong number outstanding");
+	check(Unavailable == dma.try_submit(req[0]),
+	      "submitted a busy request");
+	check(Timeout == req[Requests - 1].try_wait(0),
+	      "a queued request finished early");
+
+	for (size_t ii = 0; ii < Requests; ++ii)
+	    check(req[ii].wait(1000), "a request didn't finish");
+	check(0 == dma.outstanding(), "requests still outstanding");
+
+	for (size_t ii = 0; ii < Requests; ++ii) {
+	    uint8_t const* const data = reinterpret_cast<uint8_t*>(in[ii]);
+
+	    for (size_t jj = 0; jj < Block; ++jj)
+		check(data[jj] ==
+		      static_cast<uint8_t>((ii * Block + jj) * 7 + 1),
+		      "read the wrong data");
+	    for (size_t jj = 0; jj < 3; ++jj)
+		check(mem[Requests * Block + ii * 4 + 1 + jj] == 0xa0 + ii,
+		      "wrote the wrong data");
+	}
+
+	// A finished request can be submitted again.
+
+	dma.submit(req[0]);
+	check(req[0].wait(1000), "a resubmitted request didn't finish");
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestDma() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+#endif
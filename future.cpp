@@ -0,0 +1,188 @@
+#include <vxWorks.h>
+#include <stdexcept>
+#include "./vwpp_future.h"
+
+using namespace vwpp::v3_0;
+
+namespace {
+
+    // Woken whenever any promise is fulfilled, for when_any().
+    // wakeAll() doesn't enter the kernel unless a task is waiting
+    // on it.
+
+    Event<IntSignal> anyReady;
+}
+
+void PromiseBase::arm()
+{
+    uint32_t s = state.load(Relaxed);
+
+    do
+	if (UNLIKELY(Armed == s || Setting == s))
+	    throw std::logic_error("promise hasn't been fulfilled");
+    while (!state.compare_exchange(s, Armed, Acquire));
+}
+
+// Only one responder gets to fulfil the promise; the others find
+// it already claimed.
+
+bool PromiseBase::claim() NOTHROW_IMPL
+{
+    uint32_t expected = Armed;
+
+    return state.compare_exchange(expected, Setting, Acquire);
+}
+
+void PromiseBase::publish(Status const s) NOTHROW_IMPL
+{
+    result = s;
+    state.store(Ready, Release);
+    ev.wakeAll();
+    anyReady.wakeAll();
+}
+
+// wakeAll() only releases tasks which are already blocked, so the
+// state is checked with interrupts locked and again after each
+// wake-up. Each wait only gets what's left of the timeout. Once
+// none is left, the event is polled, which reports an empty
+// semaphore as Unavailable; to the caller, that's a timeout.
+
+Status PromiseBase::try_wait(int const tmo) NOTHROW_IMPL
+{
+    if (UNLIKELY(Empty == state.load(Relaxed)))
+	return BadHandle;
+
+    Deadline const dl(tmo);
+    IntLock lock;
+
+    while (!isReady()) {
+	Status const s = ev.try_wait(lock, dl.remaining());
+
+	if (Success != s)
+	    return Unavailable == s ? Timeout : s;
+    }
+    return result;
+}
+
+Status PromiseBase::waitAny(IntLock& lock, int const tmo) NOTHROW_IMPL
+{
+    Status const s = anyReady.try_wait(lock, tmo);
+
+    return Unavailable == s ? Timeout : s;
+}
+
+#ifndef NDEBUG
+
+#include <sysLib.h>
+#include <taskLib.h>
+#include <tickLib.h>
+#include <algorithm>
+#include <iostream>
+
+extern "C" {
+    STATUS vwppTestFutures();
+}
+
+namespace {
+
+    void check(bool const cond, char const* const what)
+    {
+	if (UNLIKELY(!cond))
+	    throw std::runtime_error(what);
+    }
+
+    // Fulfils the second promise and then, a few ticks later, the
+    // first one.
+
+    class Responder : public Task {
+	Promise<int>* const p;
+
+	void taskEntry()
+	{
+	    ::taskDelay(2);
+	    p[1].set_value(20);
+	    ::taskDelay(2);
+	    p[0].set_value(10);
+	}
+
+     public:
+	explicit Responder(Promise<int>* const pp) : p(pp) {}
+	~Responder() NOTHROW { kill(); }
+    };
+}
+
+// Regression test for Promise<>, Future<>, when_all() and
+// when_any(). A timeout, whether it expires or is 0, has to be
+// reported as Timeout. It must be run by a task.
+
+STATUS vwppTestFutures()
+{
+    try {
+	Promise<int> p[2];
+	Future<int> f[2];
+	size_t idx = 2;
+	int v = 0;
+
+	check(BadHandle == f[0].try_wait(0), "waited on an empty future");
+
+	f[0] = p[0].get_future();
+	f[1] = p[1].get_future();
+
+	check(Timeout == f[0].try_wait(0), "polling didn't time out");
+	check(!f[0].wait(0), "an unfulfilled future was ready");
+
+	bool threw = false;
+
+	try {
+	    f[0].get(0);
+	}
+	catch (timeout_error&) {
+	    threw = true;
+	}
+	check(threw, "get(0) didn't throw timeout_error");
+	check(Timeout == when_all(f, 2, 0), "when_all() didn't time out");
+	check(Timeout == when_any(f, 2, idx, 0), "when_any() didn't time out");
+
+	// A blocking wait has to give up once its timeout is used
+	// up, give or take a tick.
+
+	int const tmo = 50;
+	int const ticks = (tmo * ::sysClkRateGet() + 999) / 1000;
+	uint32_t const start = static_cast<uint32_t>(::tickGet());
+
+	check(Timeout == when_all(f, 2, tmo), "when_all() didn't time out");
+	check(static_cast<uint32_t>(::tickGet()) - start <=
+	      static_cast<uint32_t>(ticks + 1), "when_all() waited too long");
+
+	// A lower priority task fulfils the promises while this task
+	// waits for them.
+
+	Responder resp(p);
+	int pri;
+
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	resp.run("tTestFuture", std::min(pri + 10, 255), 8192);
+
+	check(Success == when_any(f, 2, idx, 1000) && 1 == idx,
+	      "when_any() didn't return the fulfilled future");
+	check(Success == when_all(f, 2, 1000), "when_all() failed");
+	check(10 == f[0].get(0) && 20 == f[1].get(0), "got the wrong values");
+	check(!p[0].set_value(30), "fulfilled a promise twice");
+
+	// A failure is reported through the future, and the promise
+	// can then be armed again.
+
+	f[0] = p[0].get_future();
+	check(p[0].set_failure(), "couldn't report a failure");
+	check(Failure == f[0].try_get(v, 0), "the failure wasn't reported");
+	check(f[0].wait(0), "a failed future wasn't ready");
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestFutures() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __INCeventLibh
+#define __INCeventLibh
+
+#include <vxWorks.h>
+
+enum {
+    EVENTS_WAIT_ALL = 0x00, EVENTS_WAIT_ANY = 0x01,
+    EVENTS_RETURN_ALL = 0x02, EVENTS_KEEP_UNWANTED = 0x04,
+    EVENTS_FETCH = 0x80
+};
+
+enum {
+    EVENTS_OPTIONS_NONE = 0x00, EVENTS_SEND_ONCE = 0x01,
+    EVENTS_ALLOW_OVERWRITE = 0x02, EVENTS_SEND_IF_FREE = 0x04
+};
+
+extern "C" {
+    STATUS eventReceive(UINT32, UINT8, int, UINT32*);
+    STATUS eventSend(int, UINT32);
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __INCfioLibh
+#define __INCfioLibh
+
+#include <vxWorks.h>
+
+extern "C" {
+    int fdprintf(int, char const*, ...);
+}
+
+#endif
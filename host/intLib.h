@@ -0,0 +1,15 @@
+#ifndef __INCintLibh
+#define __INCintLibh
+
+#include <vxWorks.h>
+
+extern "C" {
+    BOOL intContext();
+    int intLock();
+    void intUnlock(int);
+    STATUS intConnect(VOIDFUNCPTR*, VOIDFUNCPTR, int);
+    STATUS intEnable(int);
+    STATUS intDisable(int);
+}
+
+#endif
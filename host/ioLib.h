@@ -0,0 +1,8 @@
+#ifndef __INCioLibh
+#define __INCioLibh
+
+#include <vxWorks.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#endif
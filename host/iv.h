@@ -0,0 +1,9 @@
+#ifndef __INCivh
+#define __INCivh
+
+#include <intLib.h>
+
+#define INUM_TO_IVEC(n)		((VOIDFUNCPTR*) (intptr_t) (n))
+#define IVEC_TO_INUM(v)		((int) (intptr_t) (v))
+
+#endif
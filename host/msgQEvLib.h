@@ -0,0 +1,12 @@
+#ifndef __INCmsgQEvLibh
+#define __INCmsgQEvLibh
+
+#include <msgQLib.h>
+#include <eventLib.h>
+
+extern "C" {
+    STATUS msgQEvStart(MSG_Q_ID, UINT32, UINT8);
+    STATUS msgQEvStop(MSG_Q_ID);
+}
+
+#endif
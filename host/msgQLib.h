@@ -0,0 +1,20 @@
+#ifndef __INCmsgQLibh
+#define __INCmsgQLibh
+
+#include <vxWorks.h>
+
+struct msg_q;
+typedef struct msg_q* MSG_Q_ID;
+
+enum { MSG_Q_FIFO = 0x00, MSG_Q_PRIORITY = 0x01 };
+enum { MSG_PRI_NORMAL = 0, MSG_PRI_URGENT = 1 };
+
+extern "C" {
+    MSG_Q_ID msgQCreate(int, int, int);
+    STATUS msgQDelete(MSG_Q_ID);
+    int msgQNumMsgs(MSG_Q_ID);
+    int msgQReceive(MSG_Q_ID, char*, unsigned, int);
+    STATUS msgQSend(MSG_Q_ID, char*, unsigned, int, int);
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __INCsemEvLibh
+#define __INCsemEvLibh
+
+#include <semLib.h>
+#include <eventLib.h>
+
+extern "C" {
+    STATUS semEvStart(SEM_ID, UINT32, UINT8);
+    STATUS semEvStop(SEM_ID);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __INCsemLibh
+#define __INCsemLibh
+
+#include <vxWorks.h>
+
+struct semaphore;
+typedef struct semaphore* SEM_ID;
+
+enum {
+    SEM_Q_FIFO = 0x00, SEM_Q_PRIORITY = 0x01, SEM_DELETE_SAFE = 0x04,
+    SEM_INVERSION_SAFE = 0x08
+};
+
+enum { SEM_EMPTY = 0, SEM_FULL = 1 };
+
+extern "C" {
+    SEM_ID semBCreate(int, int);
+    SEM_ID semCCreate(int, int);
+    SEM_ID semMCreate(int);
+    STATUS semDelete(SEM_ID);
+    STATUS semFlush(SEM_ID);
+    STATUS semGive(SEM_ID);
+    STATUS semTake(SEM_ID, int);
+}
+
+#endif
@@ -0,0 +1,136 @@
+// A two-process test of VME::SharedRing<>. The ring is placed in
+// the host's stand-in for A32 space (see vxhost.cpp.) The parent
+// process pushes entries while a child process, which maps the space
+// on its own, pops and checks them.
+
+#ifndef NDEBUG
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <vxWorks.h>
+#include "vwpp_ring.h"
+
+using namespace vwpp::v3_0;
+
+extern "C" {
+    STATUS vwppTestSharedRing();
+}
+
+namespace {
+
+    enum { Count = 1000000, RingAddr = 0x00100000, TimeoutSecs = 10 };
+
+    // Entries span several words so a torn copy would be noticed.
+
+    struct Entry {
+	uint32_t seq;
+	uint32_t data[3];
+	uint32_t check;
+    };
+
+    typedef VME::SharedRing<Entry, 64> Ring;
+
+    // The body of the consumer process. Returns its exit status.
+
+    int consume()
+    {
+	try {
+	    Ring ring(VME::A32, RingAddr);
+	    time_t const start = time(0);
+
+	    while (!ring.ready()) {
+		if (time(0) - start > TimeoutSecs) {
+		    std::cerr << "ring was never initialized" << std::endl;
+		    return 1;
+		}
+		sched_yield();
+	    }
+
+	    Entry e;
+
+	    for (uint32_t ii = 0; ii < Count; ++ii) {
+		time_t const wait = time(0);
+
+		while (!ring.try_pop(e)) {
+		    if (time(0) - wait > TimeoutSecs) {
+			std::cerr << "timed out waiting for entry " << ii <<
+			    std::endl;
+			return 1;
+		    }
+		    sched_yield();
+		}
+		if (e.seq != ii || e.data[0] != ii * 3 ||
+		    e.data[1] != ii * 5 || e.data[2] != ii * 7 ||
+		    e.check != ~ii) {
+		    std::cerr << "entry " << ii << " is corrupt (seq " <<
+			e.seq << ")" << std::endl;
+		    return 1;
+		}
+	    }
+	    return 0;
+	}
+	catch (std::exception& e) {
+	    std::cerr << "consumer: " << e.what() << std::endl;
+	    return 1;
+	}
+    }
+}
+
+STATUS vwppTestSharedRing()
+{
+    // Use a bus of our own, so concurrent runs don't interfere and
+    // the shared memory object can be removed afterwards.
+
+    char prefix[32], path[64];
+
+    snprintf(prefix, sizeof(prefix), "vwpp%d", static_cast<int>(getpid()));
+    snprintf(path, sizeof(path), "/%s-vme-a32", prefix);
+    setenv("VWPP_HOST_VME", prefix, 1);
+
+    pid_t const child = fork();
+
+    if (child < 0)
+	return ERROR;
+    if (!child)
+	_exit(consume());
+
+    bool ok = true;
+
+    try {
+	Ring ring(VME::A32, RingAddr);
+
+	ring.init();
+	for (uint32_t ii = 0; ok && ii < Count; ++ii) {
+	    Entry const e = { ii, { ii * 3, ii * 5, ii * 7 }, ~ii };
+	    time_t const wait = time(0);
+
+	    while (ok && !ring.try_push(e))
+		if (time(0) - wait > TimeoutSecs) {
+		    std::cerr << "timed out pushing entry " << ii << std::endl;
+		    ok = false;
+		} else
+		    sched_yield();
+	}
+    }
+    catch (std::exception& e) {
+	std::cerr << "producer: " << e.what() << std::endl;
+	ok = false;
+    }
+
+    int status;
+
+    if (!ok)
+	kill(child, SIGKILL);
+    waitpid(child, &status, 0);
+    shm_unlink(path);
+    return ok && WIFEXITED(status) && 0 == WEXITSTATUS(status) ? OK : ERROR;
+}
+
+#endif
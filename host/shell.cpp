@@ -0,0 +1,83 @@
+// A stand-in for the target shell: runs one of vwpp's shell
+// commands, passing it the remaining (integer) arguments, and exits
+// with 0 if it returned OK.
+//
+//    vwpp-host vwppStress 5 2 2 2 10
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vxWorks.h>
+
+extern "C" {
+    STATUS vwppStress(int, int, int, int, int);
+#ifndef NDEBUG
+    STATUS vwppTestSemaphores();
+    STATUS vwppTestBroadcast();
+    STATUS vwppTestCountingSemaphore();
+#if __cplusplus >= 202002L
+    STATUS vwppTestCoro();
+#endif
+    STATUS vwppTestDma();
+    STATUS vwppTestFutures();
+    STATUS vwppTestEvents();
+    STATUS vwppTestLatestValue();
+    STATUS vwppTestQueues();
+    STATUS vwppTestSharedRing();
+#endif
+}
+
+namespace {
+
+    typedef STATUS (*Command)(int, int, int, int, int);
+
+    struct Entry {
+	char const* name;
+	Command func;
+    };
+
+    Entry const commands[] = {
+	{ "vwppStress", vwppStress },
+#ifndef NDEBUG
+	{ "vwppTestSemaphores", reinterpret_cast<Command>(vwppTestSemaphores) },
+	{ "vwppTestEvents", reinterpret_cast<Command>(vwppTestEvents) },
+	{ "vwppTestBroadcast", reinterpret_cast<Command>(vwppTestBroadcast) },
+	{ "vwppTestCountingSemaphore",
+	  reinterpret_cast<Command>(vwppTestCountingSemaphore) },
+#if __cplusplus >= 202002L
+	{ "vwppTestCoro", reinterpret_cast<Command>(vwppTestCoro) },
+#endif
+	{ "vwppTestDma", reinterpret_cast<Command>(vwppTestDma) },
+	{ "vwppTestFutures", reinterpret_cast<Command>(vwppTestFutures) },
+	{ "vwppTestLatestValue",
+	  reinterpret_cast<Command>(vwppTestLatestValue) },
+	{ "vwppTestQueues", reinterpret_cast<Command>(vwppTestQueues) },
+	{ "vwppTestSharedRing", reinterpret_cast<Command>(vwppTestSharedRing) },
+#endif
+    };
+}
+
+int main(int const argc, char** const argv)
+{
+    if (argc < 2) {
+	fprintf(stderr, "usage: %s command [args...]\n", argv[0]);
+	return 2;
+    }
+
+    int args[5] = { 0, 0, 0, 0, 0 };
+
+    for (int ii = 2; ii < argc && ii < 7; ++ii)
+	args[ii - 2] = strtol(argv[ii], 0, 0);
+
+    for (size_t ii = 0; ii < sizeof(commands) / sizeof(*commands); ++ii)
+	if (!strcmp(argv[1], commands[ii].name)) {
+	    STATUS const s = commands[ii].func(args[0], args[1], args[2],
+					       args[3], args[4]);
+
+	    printf("value = %d\n", s);
+	    return OK == s ? 0 : 1;
+	}
+
+    fprintf(stderr, "%s: unknown command\n", argv[1]);
+    return 2;
+}
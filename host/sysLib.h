@@ -0,0 +1,11 @@
+#ifndef __INCsysLibh
+#define __INCsysLibh
+
+#include <vxWorks.h>
+
+extern "C" {
+    int sysClkRateGet();
+    STATUS sysBusToLocalAdrs(int, char*, char**);
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __INCtaskHookLibh
+#define __INCtaskHookLibh
+
+#include <taskLib.h>
+
+extern "C" {
+    STATUS taskSwitchHookAdd(FUNCPTR);
+}
+
+#endif
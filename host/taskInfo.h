@@ -0,0 +1,18 @@
+#ifndef __INCtaskInfoh
+#define __INCtaskInfoh
+
+#include <taskLib.h>
+
+struct TASK_DESC {
+    int td_id;
+    char* td_name;
+    int td_stackSize;
+    int td_stackHigh;
+    int td_stackMargin;
+};
+
+extern "C" {
+    STATUS taskInfoGet(int, TASK_DESC*);
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __INCtaskLibh
+#define __INCtaskLibh
+
+#include <vxWorks.h>
+
+#define VX_FP_TASK	0x0008
+
+// Host tasks have no TCB that callers can look at.
+
+struct WIND_TCB;
+
+extern "C" {
+    int taskSpawn(char*, int, int, int, FUNCPTR, long, long, long, long,
+		  long, long, long, long, long, long);
+    STATUS taskDelete(int);
+    STATUS taskDelay(int);
+    int taskIdSelf();
+    STATUS taskIdVerify(int);
+    char* taskName(int);
+    STATUS taskPriorityGet(int, int*);
+    STATUS taskPrioritySet(int, int);
+    STATUS taskSuspend(int);
+    STATUS taskResume(int);
+    BOOL taskIsReady(int);
+    BOOL taskIsSuspended(int);
+    STATUS taskLock();
+    STATUS taskUnlock();
+    STATUS taskSafe();
+    STATUS taskUnsafe();
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __INCtickLibh
+#define __INCtickLibh
+
+#include <vxWorks.h>
+
+extern "C" {
+    unsigned long tickGet();
+    STATUS tickAnnounceHookAdd(FUNCPTR);
+}
+
+#endif
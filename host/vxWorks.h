@@ -0,0 +1,43 @@
+#ifndef __INCvxWorksh
+#define __INCvxWorksh
+
+// The subset of VxWorks' <vxWorks.h> that vwpp uses, for building it
+// on a POSIX host. The kernel calls are implemented by vxhost.cpp.
+// Only the names match the target's headers; the status codes have
+// different values.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define VX_VERSION	69
+
+typedef int STATUS;
+typedef int BOOL;
+typedef unsigned char UINT8;
+typedef unsigned int UINT32;
+typedef int (*FUNCPTR)(...);
+typedef void (*VOIDFUNCPTR)(...);
+
+#define OK		0
+#define ERROR		(-1)
+#define TRUE		1
+#define FALSE		0
+
+#define WAIT_FOREVER	(-1)
+#define NO_WAIT		0
+
+#define S_objLib_OBJ_ID_ERROR			0x3d0001
+#define S_objLib_OBJ_UNAVAILABLE		0x3d0002
+#define S_objLib_OBJ_DELETED			0x3d0003
+#define S_objLib_OBJ_TIMEOUT			0x3d0004
+#define S_semLib_INVALID_OPERATION		0x160068
+#define S_intLib_NOT_ISR_CALLABLE		0x430001
+#define S_msgQLib_INVALID_MSG_LENGTH		0x410001
+#define S_msgQLib_NON_ZERO_TIMEOUT_AT_INT_LEVEL	0x410002
+#define S_eventLib_TIMEOUT			0x3c0001
+#define S_eventLib_NOT_ALL_EVENTS		0x3c0002
+#define S_eventLib_ALREADY_REGISTERED		0x3c0003
+#define S_eventLib_EVENTSEND_FAILED		0x3c0004
+
+#endif
@@ -0,0 +1,1461 @@
+// This module implements the VxWorks kernel calls used by vwpp on top
+// of POSIX threads, so the library (and its stress harness and
+// tests) can run on a Linux host. It's a test backend, not an
+// emulator: it only provides what vwpp needs.
+//
+// Tasks are threads. If the process is allowed to, they are
+// scheduled with SCHED_FIFO, VxWorks priorities 0 (highest) to 255
+// being mapped onto the real-time range, and the process is bound to
+// a single CPU so, like on our (uniprocessor) targets, a task only
+// runs when no higher priority task is ready. Without the
+// privilege (or with VWPP_HOST_NORT set in the environment), the
+// threads run with the normal time-sharing policy and priorities
+// only order the wait queues.
+//
+// intLock() and taskLock() take a global lock. Watchdog routines run
+// in a thread above all tasks, holding that lock, so they exclude
+// task code that locks interrupts the same way an interrupt
+// handler does. As on VxWorks, a task that blocks while holding the
+// lock gives it up until it resumes.
+//
+// Semaphores and message queues keep their waiters in priority
+// order. Mutexes created with SEM_INVERSION_SAFE raise the owner's
+// priority to that of the highest priority waiter (one level deep;
+// chains of mutexes aren't followed.)
+//
+// A thread can't be stopped from the outside, so taskDelete() and
+// taskSuspend() of another task take effect the next time that task
+// enters the kernel. A deleted task stops there for good, unless
+// it's holding a mutex, and its thread is never reclaimed.
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vxWorks.h>
+#include <eventLib.h>
+#include <intLib.h>
+#include <msgQEvLib.h>
+#include <semEvLib.h>
+#include <sysLib.h>
+#include <taskHookLib.h>
+#include <taskInfo.h>
+#include <tickLib.h>
+#include <wdLib.h>
+#include <fioLib.h>
+
+extern "C" {
+    BOOL kernelIsIdle;
+}
+
+namespace {
+
+    enum { MaxTasks = 256, ClkRate = 1000, MinStack = 256 * 1024 };
+
+    typedef int (*Entry)(long, long, long, long, long, long, long, long,
+			 long, long);
+
+    // A wait queue holds the blocked tasks in priority order (FIFO
+    // among tasks of the same priority.)
+
+    struct Tcb;
+
+    struct WaitQ {
+	Tcb* head;
+    };
+
+    struct Tcb {
+	int id;
+	char name[32];
+	pthread_t thread;
+	pthread_cond_t cv;
+	int basePri;
+	int pri;
+	int mutexes;
+	int inheriting;
+	bool suspended;
+	bool deleted;
+
+	// Set while blocked on a semaphore or queue.
+
+	WaitQ* queue;
+	Tcb* next;
+	int result;
+
+	// VxWorks events.
+
+	uint32_t events;
+	uint32_t wanted;
+	bool allEvents;
+	bool eventWait;
+
+	Entry entry;
+	long args[10];
+    };
+
+    // Protects every kernel object and task control block.
+
+    pthread_mutex_t kernel = PTHREAD_MUTEX_INITIALIZER;
+
+    // The lock taken by intLock() and taskLock().
+
+    pthread_mutex_t bigLock;
+
+    Tcb tcbs[MaxTasks];
+    uint32_t serial;
+    bool realtime;
+    struct timespec boot;
+
+    __thread Tcb* current;
+    __thread int lockDepth;
+    __thread bool inIsr;
+
+    // VxWorks priorities run from 0 (highest) to 255. SCHED_FIFO
+    // priority 99 is reserved for the thread running the watchdogs.
+
+    int fifoPriority(int const pri)
+    {
+	return 98 - std::min(std::max(pri, 0), 255) * 97 / 255;
+    }
+
+    void setThreadPriority(pthread_t const th, int const pri)
+    {
+	if (realtime) {
+	    struct sched_param sp;
+
+	    sp.sched_priority = fifoPriority(pri);
+	    pthread_setschedparam(th, SCHED_FIFO, &sp);
+	}
+    }
+
+    int64_t nowNs()
+    {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+    }
+
+    // A point in time after which a blocking call gives up. A
+    // negative value means it never does. As on the target, a
+    // timeout ends on a clock tick (the 'ticks'th one from now), so
+    // timeouts ending on the same tick expire together.
+
+    int64_t deadline(int const ticks)
+    {
+	return ticks < 0 ? -1 :
+	    boot.tv_sec * 1000000000ll + boot.tv_nsec +
+	    static_cast<int64_t>(::tickGet() + ticks) * (1000000000 / ClkRate);
+    }
+
+    void init()
+    {
+	pthread_mutexattr_t ma;
+
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_setprotocol(&ma, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&bigLock, &ma);
+	pthread_mutexattr_destroy(&ma);
+
+	clock_gettime(CLOCK_MONOTONIC, &boot);
+
+	// Like our targets, run on one CPU. VWPP_HOST_SMP=1 lets
+	// the threads spread over all of them.
+
+	if (!getenv("VWPP_HOST_SMP")) {
+	    cpu_set_t set;
+
+	    CPU_ZERO(&set);
+	    CPU_SET(sched_getcpu() < 0 ? 0 : sched_getcpu(), &set);
+	    sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	struct sched_param sp;
+
+	sp.sched_priority = fifoPriority(1);
+	realtime = !getenv("VWPP_HOST_NORT") &&
+	    0 == pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+	if (!realtime)
+	    fprintf(stderr, "vxhost: SCHED_FIFO isn't available; task "
+		    "priorities won't be enforced\n");
+    }
+
+    pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    // Initializes a TCB in an unused slot. Must be called with
+    // 'kernel' locked.
+
+    Tcb* allocTcb(char const* const name, int const pri)
+    {
+	for (size_t ii = 0; ii < MaxTasks; ++ii) {
+	    Tcb& t = tcbs[ii];
+
+	    if (t.id)
+		continue;
+
+	    pthread_condattr_t ca;
+
+	    pthread_condattr_init(&ca);
+	    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	    pthread_cond_init(&t.cv, &ca);
+	    pthread_condattr_destroy(&ca);
+
+	    serial = (serial + 1) & 0x7fffff;
+	    t.id = static_cast<int>(((serial ? serial : 1) << 8) | ii);
+	    snprintf(t.name, sizeof(t.name), "%s", name ? name : "");
+	    t.basePri = t.pri = pri;
+	    t.mutexes = t.inheriting = 0;
+	    t.suspended = t.deleted = false;
+	    t.queue = 0;
+	    t.next = 0;
+	    t.result = 0;
+	    t.events = t.wanted = 0;
+	    t.allEvents = t.eventWait = false;
+	    return &t;
+	}
+	return 0;
+    }
+
+    void freeTcb(Tcb* const t)
+    {
+	pthread_cond_destroy(&t->cv);
+	t->id = 0;
+    }
+
+    // Returns the TCB of the calling thread. Threads that weren't
+    // created by taskSpawn() (e.g. main()) get one the first time
+    // they use the kernel; the first one becomes the "shell", which
+    // runs at priority 1 like the target shell.
+
+    Tcb* self()
+    {
+	if (!current) {
+	    pthread_once(&once, init);
+	    pthread_mutex_lock(&kernel);
+
+	    static int adopted;
+	    char name[16];
+
+	    snprintf(name, sizeof(name), adopted ? "tHost%d" : "tShell",
+		     adopted);
+	    current = allocTcb(name, adopted++ ? 100 : 1);
+	    if (current)
+		current->thread = pthread_self();
+	    pthread_mutex_unlock(&kernel);
+	    if (!current)
+		abort();
+	}
+	return current;
+    }
+
+    Tcb* lookup(int const id)
+    {
+	if (!id)
+	    return self();
+
+	Tcb* const t = tcbs + (id & 0xff);
+
+	return id > 0 && t->id == id && !t->deleted ? t : 0;
+    }
+
+    // Wait queue operations. These are done with 'kernel' locked.
+
+    void enqueue(WaitQ& q, Tcb* const t)
+    {
+	Tcb** ptr = &q.head;
+
+	while (*ptr && (*ptr)->pri <= t->pri)
+	    ptr = &(*ptr)->next;
+	t->next = *ptr;
+	*ptr = t;
+	t->queue = &q;
+    }
+
+    void unlink(Tcb* const t)
+    {
+	if (!t->queue)
+	    return;
+	for (Tcb** ptr = &t->queue->head; *ptr; ptr = &(*ptr)->next)
+	    if (*ptr == t) {
+		*ptr = t->next;
+		break;
+	    }
+	t->queue = 0;
+	t->next = 0;
+    }
+
+    // Ends the wait of a blocked task with 'result' (OK or an errno
+    // value.)
+
+    void wake(Tcb* const t, int const result)
+    {
+	unlink(t);
+	t->result = result;
+	pthread_cond_signal(&t->cv);
+    }
+
+    Tcb* first(WaitQ& q)
+    {
+	return q.head;
+    }
+
+    void wakeAll(WaitQ& q, int const result)
+    {
+	while (q.head)
+	    wake(q.head, result);
+    }
+
+    void setPriority(Tcb* const t, int const pri)
+    {
+	if (t->pri == pri)
+	    return;
+	t->pri = pri;
+	setThreadPriority(t->thread, pri);
+	if (t->queue) {
+	    WaitQ& q = *t->queue;
+
+	    unlink(t);
+	    enqueue(q, t);
+	}
+    }
+
+    // Sleeps on the task's condition variable until it's signalled
+    // or the deadline passes. Returns false in the latter case.
+
+    bool sleep(Tcb* const t, int64_t const dl)
+    {
+	if (dl < 0) {
+	    pthread_cond_wait(&t->cv, &kernel);
+	    return true;
+	}
+
+	struct timespec ts;
+
+	ts.tv_sec = dl / 1000000000;
+	ts.tv_nsec = dl % 1000000000;
+	return ETIMEDOUT != pthread_cond_timedwait(&t->cv, &kernel, &ts);
+    }
+
+    // The result a woken task sees when it got what it waited for.
+    // (Zero means "still waiting".)
+
+    int const Granted = -1;
+
+    // Deleted tasks wait here, forever, after giving up their TCB.
+
+    pthread_cond_t graveyard = PTHREAD_COND_INITIALIZER;
+
+    // Every kernel call creates one of these. It locks the kernel
+    // and, before the caller blocks, releases the interrupt lock
+    // which the task may be holding; it's reacquired on the way out.
+    // Pending suspensions and deletions are carried out on the way
+    // out, too.
+
+    class KernelCall {
+	int saved;
+
+	KernelCall(KernelCall const&);
+	KernelCall& operator=(KernelCall const&);
+
+     public:
+	Tcb* const me;
+
+	KernelCall() : saved(0), me(inIsr ? 0 : self())
+	{
+	    pthread_mutex_lock(&kernel);
+	}
+
+	~KernelCall()
+	{
+	    if (me && me->suspended) {
+		release();
+		while (me->suspended && !me->deleted)
+		    pthread_cond_wait(&me->cv, &kernel);
+	    }
+	    if (me && me->deleted && !me->mutexes) {
+		release();
+		freeTcb(me);
+		current = 0;
+		while (true)
+		    pthread_cond_wait(&graveyard, &kernel);
+	    }
+	    pthread_mutex_unlock(&kernel);
+	    if (saved) {
+		pthread_mutex_lock(&bigLock);
+		lockDepth = saved;
+	    }
+	}
+
+	void release()
+	{
+	    if (lockDepth && !inIsr) {
+		saved = lockDepth;
+		lockDepth = 0;
+		pthread_mutex_unlock(&bigLock);
+	    }
+	}
+
+	// Blocks the caller on 'q' until another call wakes it up or
+	// the deadline passes. Returns OK or an errno value.
+
+	int block(WaitQ& q, int64_t const dl)
+	{
+	    release();
+	    enqueue(q, me);
+	    me->result = 0;
+	    while (!me->result)
+		if (!sleep(me, dl) && !me->result) {
+		    unlink(me);
+		    me->result = S_objLib_OBJ_TIMEOUT;
+		}
+	    return me->result == Granted ? OK : me->result;
+	}
+    };
+
+    STATUS fail(int const err)
+    {
+	errno = err;
+	return ERROR;
+    }
+
+    // Sends events to a task. Must be called with 'kernel' locked.
+
+    STATUS send(Tcb* const t, uint32_t const ev)
+    {
+	if (!t || !t->id)
+	    return ERROR;
+	t->events |= ev;
+	if (t->eventWait && (t->allEvents ?
+			     (t->events & t->wanted) == t->wanted :
+			     (t->events & t->wanted) != 0))
+	    pthread_cond_signal(&t->cv);
+	return OK;
+    }
+
+    // The registration made by semEvStart() or msgQEvStart().
+
+    struct EventReg {
+	Tcb* task;
+	int taskId;
+	uint32_t events;
+	uint8_t options;
+
+	void notify()
+	{
+	    if (task && task->id == taskId) {
+		send(task, events);
+		if (options & EVENTS_SEND_ONCE)
+		    task = 0;
+	    }
+	}
+    };
+
+    STATUS startEvents(EventReg& reg, Tcb* const me, uint32_t const ev,
+		       uint8_t const opts, bool const avail)
+    {
+	if (reg.task && reg.task->id == reg.taskId && reg.task != me &&
+	    !(opts & EVENTS_ALLOW_OVERWRITE))
+	    return fail(S_eventLib_ALREADY_REGISTERED);
+	reg.task = me;
+	reg.taskId = me->id;
+	reg.events = ev;
+	reg.options = opts;
+	if ((opts & EVENTS_SEND_IF_FREE) && avail)
+	    reg.notify();
+	return OK;
+    }
+
+    STATUS stopEvents(EventReg& reg, Tcb* const me)
+    {
+	if (reg.task != me)
+	    return fail(S_eventLib_ALREADY_REGISTERED);
+	reg.task = 0;
+	return OK;
+    }
+
+    // The watchdogs are kept in a list sorted by expiration time.
+
+    pthread_cond_t timerCv;
+    bool timerRunning;
+}
+
+struct semaphore {
+    enum Type { Binary, Counting, MutualExclusion } type;
+    int options;
+    int count;
+    Tcb* owner;
+    WaitQ waiters;
+    EventReg reg;
+};
+
+struct msg_q {
+    int maxMsgs;
+    int maxLen;
+    char* data;
+    int* lens;
+    int head;
+    int used;
+    WaitQ readers;
+    WaitQ writers;
+    EventReg reg;
+};
+
+struct wdog {
+    wdog* next;
+    bool armed;
+    int64_t due;
+    FUNCPTR func;
+    long arg;
+};
+
+namespace {
+    wdog* timers;
+
+    void unlinkTimer(wdog* const w)
+    {
+	for (wdog** ptr = &timers; *ptr; ptr = &(*ptr)->next)
+	    if (*ptr == w) {
+		*ptr = w->next;
+		break;
+	    }
+	w->armed = false;
+    }
+
+    // The "interrupt" thread. Each expired watchdog routine runs
+    // with the interrupt lock held and intContext() returning TRUE.
+
+    void* timerThread(void*)
+    {
+	pthread_mutex_lock(&kernel);
+	while (true) {
+	    if (!timers) {
+		pthread_cond_wait(&timerCv, &kernel);
+		continue;
+	    }
+
+	    int64_t const due = timers->due;
+
+	    if (nowNs() < due) {
+		struct timespec ts;
+
+		ts.tv_sec = due / 1000000000;
+		ts.tv_nsec = due % 1000000000;
+		pthread_cond_timedwait(&timerCv, &kernel, &ts);
+		continue;
+	    }
+
+	    wdog* const w = timers;
+	    FUNCPTR const func = w->func;
+	    long const arg = w->arg;
+
+	    unlinkTimer(w);
+	    pthread_mutex_unlock(&kernel);
+
+	    pthread_mutex_lock(&bigLock);
+	    inIsr = true;
+	    lockDepth = 1;
+	    reinterpret_cast<void (*)(long)>(func)(arg);
+	    lockDepth = 0;
+	    inIsr = false;
+	    pthread_mutex_unlock(&bigLock);
+
+	    pthread_mutex_lock(&kernel);
+	}
+	return 0;
+    }
+
+    // Starts the thread running the watchdogs. Called with 'kernel'
+    // locked.
+
+    void startTimer()
+    {
+	if (timerRunning)
+	    return;
+
+	pthread_condattr_t ca;
+
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&timerCv, &ca);
+	pthread_condattr_destroy(&ca);
+
+	pthread_attr_t attr;
+	pthread_t th;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (realtime) {
+	    struct sched_param sp;
+
+	    sp.sched_priority = 99;
+	    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	    pthread_attr_setschedparam(&attr, &sp);
+	}
+	if (0 == pthread_create(&th, &attr, timerThread, 0))
+	    timerRunning = true;
+	pthread_attr_destroy(&attr);
+    }
+
+    // The start routine of spawned tasks.
+
+    void* taskThread(void* const arg)
+    {
+	Tcb* const t = static_cast<Tcb*>(arg);
+
+	current = t;
+	pthread_mutex_lock(&kernel);
+	t->thread = pthread_self();
+	pthread_mutex_unlock(&kernel);
+
+	t->entry(t->args[0], t->args[1], t->args[2], t->args[3], t->args[4],
+		 t->args[5], t->args[6], t->args[7], t->args[8], t->args[9]);
+
+	pthread_mutex_lock(&kernel);
+	freeTcb(t);
+	pthread_mutex_unlock(&kernel);
+	return 0;
+    }
+}
+
+// **** Semaphores
+
+namespace {
+    SEM_ID semCreate(semaphore::Type const type, int const opts,
+		     int const count)
+    {
+	pthread_once(&once, init);
+
+	semaphore* const s = new semaphore;
+
+	s->type = type;
+	s->options = opts;
+	s->count = count;
+	s->owner = 0;
+	s->waiters.head = 0;
+	s->reg.task = 0;
+	return s;
+    }
+
+    // Gives a mutex to its next owner (or makes it free.) Called
+    // when the owner's recursion count reaches zero.
+
+    void handOver(SEM_ID const s)
+    {
+	Tcb* const prev = s->owner;
+
+	--prev->mutexes;
+	if (s->options & SEM_INVERSION_SAFE) {
+	    if (!--prev->inheriting)
+		setPriority(prev, prev->basePri);
+	}
+
+	Tcb* const next = first(s->waiters);
+
+	s->owner = next;
+	if (next) {
+	    s->count = 1;
+	    ++next->mutexes;
+	    if (s->options & SEM_INVERSION_SAFE)
+		++next->inheriting;
+	    wake(next, Granted);
+	} else
+	    s->reg.notify();
+    }
+}
+
+SEM_ID semBCreate(int const opts, int const state)
+{
+    return semCreate(semaphore::Binary, opts, state == SEM_FULL ? 1 : 0);
+}
+
+SEM_ID semCCreate(int const opts, int const count)
+{
+    return semCreate(semaphore::Counting, opts, count);
+}
+
+SEM_ID semMCreate(int const opts)
+{
+    return semCreate(semaphore::MutualExclusion, opts, 0);
+}
+
+STATUS semTake(SEM_ID const s, int const ticks)
+{
+    if (!s)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    if (inIsr)
+	return fail(S_intLib_NOT_ISR_CALLABLE);
+
+    KernelCall k;
+
+    if (semaphore::MutualExclusion == s->type) {
+	if (s->owner == k.me) {
+	    ++s->count;
+	    return OK;
+	}
+	if (!s->owner) {
+	    s->owner = k.me;
+	    s->count = 1;
+	    ++k.me->mutexes;
+	    if (s->options & SEM_INVERSION_SAFE)
+		++k.me->inheriting;
+	    return OK;
+	}
+	if (!ticks)
+	    return fail(S_objLib_OBJ_UNAVAILABLE);
+	if ((s->options & SEM_INVERSION_SAFE) && s->owner->pri > k.me->pri)
+	    setPriority(s->owner, k.me->pri);
+    } else if (s->count) {
+	--s->count;
+	return OK;
+    } else if (!ticks)
+	return fail(S_objLib_OBJ_UNAVAILABLE);
+
+    int const result = k.block(s->waiters, deadline(ticks));
+
+    return OK == result ? OK : fail(result);
+}
+
+STATUS semGive(SEM_ID const s)
+{
+    if (!s)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    if (semaphore::MutualExclusion == s->type) {
+	if (inIsr || s->owner != k.me)
+	    return fail(S_semLib_INVALID_OPERATION);
+	if (!--s->count)
+	    handOver(s);
+	return OK;
+    }
+
+    Tcb* const t = first(s->waiters);
+
+    if (t)
+	wake(t, Granted);
+    else {
+	if (semaphore::Binary == s->type)
+	    s->count = 1;
+	else
+	    ++s->count;
+	s->reg.notify();
+    }
+    return OK;
+}
+
+STATUS semFlush(SEM_ID const s)
+{
+    if (!s)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    if (semaphore::MutualExclusion == s->type)
+	return fail(S_semLib_INVALID_OPERATION);
+    wakeAll(s->waiters, Granted);
+    return OK;
+}
+
+STATUS semDelete(SEM_ID const s)
+{
+    if (!s)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    {
+	KernelCall k;
+
+	wakeAll(s->waiters, S_objLib_OBJ_DELETED);
+	if (s->owner) {
+	    --s->owner->mutexes;
+	    if ((s->options & SEM_INVERSION_SAFE) &&
+		!--s->owner->inheriting)
+		setPriority(s->owner, s->owner->basePri);
+	}
+    }
+    delete s;
+    return OK;
+}
+
+STATUS semEvStart(SEM_ID const s, UINT32 const ev, UINT8 const opts)
+{
+    if (!s)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    return startEvents(s->reg, k.me, ev, opts,
+		       semaphore::MutualExclusion == s->type ?
+		       !s->owner : s->count > 0);
+}
+
+STATUS semEvStop(SEM_ID const s)
+{
+    if (!s)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    return stopEvents(s->reg, k.me);
+}
+
+// **** Message queues
+
+MSG_Q_ID msgQCreate(int const maxMsgs, int const maxLen, int)
+{
+    pthread_once(&once, init);
+    if (maxMsgs <= 0 || maxLen < 0)
+	return 0;
+
+    msg_q* const q = new msg_q;
+
+    q->maxMsgs = maxMsgs;
+    q->maxLen = maxLen;
+    q->data = new char[maxMsgs * std::max(maxLen, 1)];
+    q->lens = new int[maxMsgs];
+    q->head = q->used = 0;
+    q->readers.head = q->writers.head = 0;
+    q->reg.task = 0;
+    return q;
+}
+
+STATUS msgQDelete(MSG_Q_ID const q)
+{
+    if (!q)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    {
+	KernelCall k;
+
+	wakeAll(q->readers, S_objLib_OBJ_DELETED);
+	wakeAll(q->writers, S_objLib_OBJ_DELETED);
+    }
+    delete [] q->data;
+    delete [] q->lens;
+    delete q;
+    return OK;
+}
+
+int msgQNumMsgs(MSG_Q_ID const q)
+{
+    if (!q)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    return q->used;
+}
+
+STATUS msgQSend(MSG_Q_ID const q, char* const buf, unsigned const len,
+		int const ticks, int const pri)
+{
+    if (!q)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    if (len > static_cast<unsigned>(q->maxLen))
+	return fail(S_msgQLib_INVALID_MSG_LENGTH);
+    if (inIsr && ticks)
+	return fail(S_msgQLib_NON_ZERO_TIMEOUT_AT_INT_LEVEL);
+
+    KernelCall k;
+    int64_t const dl = deadline(ticks);
+
+    while (q->used == q->maxMsgs) {
+	if (!ticks)
+	    return fail(S_objLib_OBJ_UNAVAILABLE);
+
+	int const result = k.block(q->writers, dl);
+
+	if (OK != result)
+	    return fail(result);
+    }
+
+    int const idx = MSG_PRI_URGENT == pri ?
+	(q->head = (q->head + q->maxMsgs - 1) % q->maxMsgs) :
+	(q->head + q->used) % q->maxMsgs;
+
+    memcpy(q->data + idx * q->maxLen, buf, len);
+    q->lens[idx] = len;
+    ++q->used;
+
+    Tcb* const t = first(q->readers);
+
+    if (t)
+	wake(t, Granted);
+    else
+	q->reg.notify();
+    return OK;
+}
+
+int msgQReceive(MSG_Q_ID const q, char* const buf, unsigned const max,
+		int const ticks)
+{
+    if (!q)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    if (inIsr && ticks)
+	return fail(S_msgQLib_NON_ZERO_TIMEOUT_AT_INT_LEVEL);
+
+    KernelCall k;
+    int64_t const dl = deadline(ticks);
+
+    while (!q->used) {
+	if (!ticks)
+	    return fail(S_objLib_OBJ_UNAVAILABLE);
+
+	int const result = k.block(q->readers, dl);
+
+	if (OK != result)
+	    return fail(result);
+    }
+
+    int const len = std::min(q->lens[q->head], static_cast<int>(max));
+
+    memcpy(buf, q->data + q->head * q->maxLen, len);
+    q->head = (q->head + 1) % q->maxMsgs;
+    --q->used;
+
+    Tcb* const t = first(q->writers);
+
+    if (t)
+	wake(t, Granted);
+    return len;
+}
+
+STATUS msgQEvStart(MSG_Q_ID const q, UINT32 const ev, UINT8 const opts)
+{
+    if (!q)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    return startEvents(q->reg, k.me, ev, opts, q->used > 0);
+}
+
+STATUS msgQEvStop(MSG_Q_ID const q)
+{
+    if (!q)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    return stopEvents(q->reg, k.me);
+}
+
+// **** Events
+
+STATUS eventSend(int const id, UINT32 const ev)
+{
+    KernelCall k;
+    Tcb* const t = id ? lookup(id) : k.me;
+
+    return t ? send(t, ev) : fail(S_objLib_OBJ_ID_ERROR);
+}
+
+STATUS eventReceive(UINT32 const ev, UINT8 const opts, int const ticks,
+		    UINT32* const received)
+{
+    if (inIsr)
+	return fail(S_intLib_NOT_ISR_CALLABLE);
+
+    KernelCall k;
+    Tcb* const me = k.me;
+
+    if (opts & EVENTS_FETCH) {
+	if (received)
+	    *received = me->events;
+	me->events = 0;
+	return OK;
+    }
+
+    int64_t const dl = deadline(ticks);
+    bool const any = opts & EVENTS_WAIT_ANY;
+
+    while (any ? !(me->events & ev) : (me->events & ev) != ev) {
+	if (!ticks) {
+	    if (received)
+		*received = me->events & ev;
+	    return fail(S_eventLib_NOT_ALL_EVENTS);
+	}
+
+	k.release();
+	me->wanted = ev;
+	me->allEvents = !any;
+	me->eventWait = true;
+
+	bool const ok = sleep(me, dl) && !me->deleted;
+
+	me->eventWait = false;
+	if (!ok && (any ? !(me->events & ev) : (me->events & ev) != ev)) {
+	    if (received)
+		*received = me->events & ev;
+	    return fail(S_eventLib_TIMEOUT);
+	}
+    }
+
+    uint32_t const got = (opts & EVENTS_RETURN_ALL) ? me->events :
+	me->events & ev;
+
+    if (received)
+	*received = got;
+    me->events = (opts & EVENTS_KEEP_UNWANTED) ? me->events & ~ev : 0;
+    return OK;
+}
+
+// **** Tasks
+
+int taskSpawn(char* const name, int const pri, int, int const stack,
+	      FUNCPTR const entry, long const a0, long const a1,
+	      long const a2, long const a3, long const a4, long const a5,
+	      long const a6, long const a7, long const a8, long const a9)
+{
+    pthread_once(&once, init);
+
+    Tcb* t;
+
+    {
+	KernelCall k;
+
+	if (!(t = allocTcb(name, pri)))
+	    return fail(S_objLib_OBJ_UNAVAILABLE);
+    }
+
+    t->entry = reinterpret_cast<Entry>(entry);
+    t->args[0] = a0;
+    t->args[1] = a1;
+    t->args[2] = a2;
+    t->args[3] = a3;
+    t->args[4] = a4;
+    t->args[5] = a5;
+    t->args[6] = a6;
+    t->args[7] = a7;
+    t->args[8] = a8;
+    t->args[9] = a9;
+
+    // Host code needs a lot more stack than the target.
+
+    pthread_attr_t attr;
+    pthread_t th;
+    int const id = t->id;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, std::max(stack, int(MinStack)));
+    if (realtime) {
+	struct sched_param sp;
+
+	sp.sched_priority = fifoPriority(pri);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &sp);
+    }
+
+    int const err = pthread_create(&th, &attr, taskThread, t);
+
+    pthread_attr_destroy(&attr);
+    if (err) {
+	KernelCall k;
+
+	freeTcb(t);
+	return fail(S_objLib_OBJ_UNAVAILABLE);
+    }
+    return id;
+}
+
+STATUS taskDelete(int const id)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    if (!t)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    // The task disappears right away. Its TCB is released once its
+    // thread notices.
+
+    t->deleted = true;
+    if (t->queue)
+	wake(t, S_objLib_OBJ_DELETED);
+    pthread_cond_signal(&t->cv);
+    return OK;
+}
+
+STATUS taskDelay(int const ticks)
+{
+    if (inIsr)
+	return fail(S_intLib_NOT_ISR_CALLABLE);
+
+    KernelCall k;
+
+    k.release();
+    if (ticks <= 0) {
+	pthread_mutex_unlock(&kernel);
+	sched_yield();
+	pthread_mutex_lock(&kernel);
+	return OK;
+    }
+
+    int64_t const dl = deadline(ticks);
+
+    while (sleep(k.me, dl) && !k.me->deleted)
+	;
+    return OK;
+}
+
+int taskIdSelf()
+{
+    return self()->id;
+}
+
+STATUS taskIdVerify(int const id)
+{
+    KernelCall k;
+
+    return id && lookup(id) ? OK : fail(S_objLib_OBJ_ID_ERROR);
+}
+
+char* taskName(int const id)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    return t ? t->name : 0;
+}
+
+STATUS taskPriorityGet(int const id, int* const pri)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    if (!t)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    *pri = t->pri;
+    return OK;
+}
+
+// An inherited priority is kept until the task releases its
+// inversion-safe mutexes.
+
+STATUS taskPrioritySet(int const id, int const pri)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    if (!t)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    t->basePri = pri;
+    if (!t->inheriting || pri < t->pri)
+	setPriority(t, pri);
+    return OK;
+}
+
+STATUS taskSuspend(int const id)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    if (!t)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    t->suspended = true;
+    return OK;
+}
+
+STATUS taskResume(int const id)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    if (!t)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    t->suspended = false;
+    pthread_cond_signal(&t->cv);
+    return OK;
+}
+
+BOOL taskIsReady(int const id)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    return t && !t->suspended && !t->queue && !t->eventWait;
+}
+
+BOOL taskIsSuspended(int const id)
+{
+    KernelCall k;
+    Tcb* const t = lookup(id);
+
+    return t && t->suspended;
+}
+
+STATUS taskLock()
+{
+    intLock();
+    return OK;
+}
+
+STATUS taskUnlock()
+{
+    intUnlock(lockDepth - 1);
+    return OK;
+}
+
+STATUS taskSafe()
+{
+    return OK;
+}
+
+STATUS taskUnsafe()
+{
+    return OK;
+}
+
+// These need kernel support the host doesn't have.
+
+STATUS taskInfoGet(int, TASK_DESC*)
+{
+    return ERROR;
+}
+
+STATUS taskSwitchHookAdd(FUNCPTR)
+{
+    return ERROR;
+}
+
+STATUS tickAnnounceHookAdd(FUNCPTR)
+{
+    return ERROR;
+}
+
+STATUS intConnect(VOIDFUNCPTR*, VOIDFUNCPTR, int)
+{
+    return ERROR;
+}
+
+STATUS intEnable(int)
+{
+    return ERROR;
+}
+
+STATUS intDisable(int)
+{
+    return ERROR;
+}
+
+// **** VME bus
+
+// Each VME address space is a shared memory object, named
+// /<prefix>-vme-a16 (-a24, -a32), so processes using the same prefix
+// see the same "bus" and can stand in for boards sharing memory
+// over the backplane. The prefix is "vwpp" unless VWPP_HOST_VME is
+// set. Only the first 64 MB of A32 space exist. There are no boards
+// on this bus, so the spaces hold plain memory; the objects persist
+// (in /dev/shm) until they're removed.
+
+namespace {
+
+    struct BusSpace {
+	char const* name;
+	uint32_t size;
+	uint8_t* base;
+    };
+
+    BusSpace bus[] = {
+	{ "a16", 0x10000, 0 },
+	{ "a24", 0x1000000, 0 },
+	{ "a32", 0x4000000, 0 }
+    };
+
+    pthread_mutex_t busMtx = PTHREAD_MUTEX_INITIALIZER;
+
+    // Maps an address space, the first time it's used. Must be
+    // called with 'busMtx' locked.
+
+    uint8_t* mapSpace(BusSpace& s)
+    {
+	if (!s.base) {
+	    char const* const prefix = getenv("VWPP_HOST_VME");
+	    char path[64];
+
+	    snprintf(path, sizeof(path), "/%s-vme-%s",
+		     prefix ? prefix : "vwpp", s.name);
+
+	    int const fd = shm_open(path, O_RDWR | O_CREAT, 0600);
+
+	    if (fd < 0)
+		return 0;
+
+	    void* const p = 0 == ftruncate(fd, s.size) ?
+		mmap(0, s.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) :
+		MAP_FAILED;
+
+	    close(fd);
+	    if (MAP_FAILED != p)
+		s.base = static_cast<uint8_t*>(p);
+	}
+	return s.base;
+    }
+}
+
+// The address space is picked from the address modifier's upper
+// bits, so the supervisory and user variants all map the same
+// memory.
+
+STATUS sysBusToLocalAdrs(int const am, char* const addr, char** const local)
+{
+    BusSpace* s;
+
+    switch (am & 0x38) {
+     case 0x28:
+	s = &bus[0];
+	break;
+
+     case 0x38:
+	s = &bus[1];
+	break;
+
+     case 0x08:
+	s = &bus[2];
+	break;
+
+     default:
+	return ERROR;
+    }
+
+    uintptr_t const offset = reinterpret_cast<uintptr_t>(addr);
+
+    if (offset >= s->size)
+	return ERROR;
+
+    pthread_mutex_lock(&busMtx);
+
+    uint8_t* const base = mapSpace(*s);
+
+    pthread_mutex_unlock(&busMtx);
+    if (!base)
+	return ERROR;
+    *local = reinterpret_cast<char*>(base + offset);
+    return OK;
+}
+
+// **** Interrupt lock
+
+BOOL intContext()
+{
+    return inIsr;
+}
+
+int intLock()
+{
+    pthread_once(&once, init);
+    if (!lockDepth++)
+	pthread_mutex_lock(&bigLock);
+    return lockDepth - 1;
+}
+
+void intUnlock(int const level)
+{
+    if (lockDepth > level && !(lockDepth = level))
+	pthread_mutex_unlock(&bigLock);
+}
+
+// **** Clock and watchdogs
+
+unsigned long tickGet()
+{
+    pthread_once(&once, init);
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - boot.tv_sec) * ClkRate +
+	(ts.tv_nsec - boot.tv_nsec) / (1000000000 / ClkRate);
+}
+
+int sysClkRateGet()
+{
+    return ClkRate;
+}
+
+WDOG_ID wdCreate()
+{
+    pthread_once(&once, init);
+
+    wdog* const w = new wdog;
+
+    w->next = 0;
+    w->armed = false;
+    return w;
+}
+
+STATUS wdDelete(WDOG_ID const w)
+{
+    if (!w)
+	return fail(S_objLib_OBJ_ID_ERROR);
+    {
+	KernelCall k;
+
+	if (w->armed)
+	    unlinkTimer(w);
+    }
+    delete w;
+    return OK;
+}
+
+STATUS wdStart(WDOG_ID const w, int const ticks, FUNCPTR const func,
+	       long const arg)
+{
+    if (!w)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    if (w->armed)
+	unlinkTimer(w);
+    w->due = deadline(std::max(ticks, 1));
+    w->func = func;
+    w->arg = arg;
+    w->armed = true;
+
+    wdog** ptr = &timers;
+
+    while (*ptr && (*ptr)->due <= w->due)
+	ptr = &(*ptr)->next;
+    w->next = *ptr;
+    *ptr = w;
+
+    startTimer();
+    pthread_cond_signal(&timerCv);
+    return OK;
+}
+
+STATUS wdCancel(WDOG_ID const w)
+{
+    if (!w)
+	return fail(S_objLib_OBJ_ID_ERROR);
+
+    KernelCall k;
+
+    if (w->armed)
+	unlinkTimer(w);
+    return OK;
+}
+
+int fdprintf(int const fd, char const* const fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+
+    int const n = vdprintf(fd, fmt, ap);
+
+    va_end(ap);
+    return n;
+}
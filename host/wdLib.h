@@ -0,0 +1,16 @@
+#ifndef __INCwdLibh
+#define __INCwdLibh
+
+#include <vxWorks.h>
+
+struct wdog;
+typedef struct wdog* WDOG_ID;
+
+extern "C" {
+    WDOG_ID wdCreate();
+    STATUS wdDelete(WDOG_ID);
+    STATUS wdStart(WDOG_ID, int, FUNCPTR, long);
+    STATUS wdCancel(WDOG_ID);
+}
+
+#endif
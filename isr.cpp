@@ -0,0 +1,171 @@
+#include <vxWorks.h>
+#include <intLib.h>
+#include <iv.h>
+#include <stdio.h>
+#include <stdexcept>
+#include "./vwpp_isr.h"
+#include "./vwpp_time.h"
+
+using namespace vwpp::v3_0;
+
+namespace {
+
+    // One entry per interrupt vector. 'total' and 'max' are kept
+    // in time base counts and converted when they're read.
+
+    struct Slot {
+	InterruptBase::Dispatch fn;
+	void* obj;
+	bool stats;
+	bool connected;
+	uint32_t count;
+	uint64_t total;
+	uint32_t max;
+    };
+
+    Slot table[InterruptBase::MaxVectors];
+
+    // Serializes attaching and detaching handlers.
+
+    Mutex isrMtx;
+
+    // Every connected vector runs this routine. The slot is only
+    // changed with interrupts locked, so it's consistent here.
+
+    void trampoline(int const vec)
+    {
+	Slot& s = table[vec];
+
+	if (UNLIKELY(!s.fn))
+	    return;
+
+	if (!s.stats)
+	    s.fn(s.obj);
+	else {
+	    uint32_t const start = read_timebase();
+
+	    s.fn(s.obj);
+
+	    uint32_t const delta = read_timebase() - start;
+
+	    ++s.count;
+	    s.total += delta;
+	    if (delta > s.max)
+		s.max = delta;
+	}
+    }
+}
+
+InterruptBase::InterruptBase(int const vec, Dispatch const fn,
+			     void* const obj, bool const stats) :
+    vector(vec)
+{
+    if (UNLIKELY(vec < 0 || vec >= MaxVectors))
+	throw std::out_of_range("interrupt vector out of range");
+
+    // Calibrate the time base now, since it can't be done at
+    // interrupt level.
+
+    if (stats)
+	timebase_hz();
+
+    Mutex::Lock<isrMtx> lock;
+    Slot& s = table[vec];
+
+    if (UNLIKELY(s.fn != 0))
+	throw std::logic_error("interrupt vector already has a handler");
+
+    if (!s.connected) {
+	if (ERROR == ::intConnect(INUM_TO_IVEC(vec),
+				  reinterpret_cast<VOIDFUNCPTR>(trampoline),
+				  vec))
+	    throw std::runtime_error("couldn't connect interrupt");
+	s.connected = true;
+    }
+
+    IntLock iLock;
+
+    s.obj = obj;
+    s.stats = stats;
+    s.count = 0;
+    s.total = 0;
+    s.max = 0;
+    s.fn = fn;
+}
+
+InterruptBase::~InterruptBase() NOTHROW_IMPL
+{
+    Mutex::Lock<isrMtx> lock;
+    IntLock iLock;
+
+    table[vector].fn = 0;
+    table[vector].obj = 0;
+}
+
+IsrStats InterruptBase::stats() const
+{
+    IsrStats tmp;
+
+    {
+	IntLock lock;
+	Slot const& s = table[vector];
+
+	tmp.count = s.count;
+	tmp.totalTime = s.total;
+	tmp.maxTime = s.max;
+    }
+    tmp.totalTime = counts_to_us(tmp.totalTime);
+    tmp.maxTime = static_cast<uint32_t>(counts_to_us(tmp.maxTime));
+    return tmp;
+}
+
+void InterruptBase::resetStats() NOTHROW_IMPL
+{
+    IntLock lock;
+    Slot& s = table[vector];
+
+    s.count = 0;
+    s.total = 0;
+    s.max = 0;
+}
+
+void InterruptBase::show()
+{
+    printf("%6s %10s %12s %8s %8s\n", "VECTOR", "COUNT", "TOTAL(us)",
+	   "AVG(us)", "MAX(us)");
+
+    Mutex::Lock<isrMtx> lock;
+
+    for (size_t ii = 0; ii < MaxVectors; ++ii) {
+	uint32_t count, max;
+	uint64_t total;
+
+	{
+	    IntLock iLock;
+	    Slot const& s = table[ii];
+
+	    if (!s.fn || !s.stats)
+		continue;
+	    count = s.count;
+	    total = s.total;
+	    max = s.max;
+	}
+	printf("%6u %10u %12u %8u %8u\n", static_cast<unsigned>(ii),
+	       static_cast<unsigned>(count),
+	       static_cast<unsigned>(counts_to_us(total)),
+	       static_cast<unsigned>(count ? counts_to_us(total / count) : 0),
+	       static_cast<unsigned>(counts_to_us(max)));
+    }
+}
+
+STATUS vwppIsrShow()
+{
+    try {
+	InterruptBase::show();
+	return OK;
+    }
+    catch (std::exception& e) {
+	printf("vwppIsrShow() : %s\n", e.what());
+	return ERROR;
+    }
+}
@@ -0,0 +1,181 @@
+#include <vxWorks.h>
+#include <fioLib.h>
+#include <stdio.h>
+#include <stdexcept>
+#include "./vwpp_log.h"
+#include "./vwpp_time.h"
+
+using namespace vwpp::v3_0;
+
+namespace {
+
+    // A record is ready to be formatted when its 'seq' field holds
+    // its ring index plus one. It's written last, so a reader never
+    // sees a partially filled record.
+
+    struct Record {
+	Atomic<uint32_t> seq;
+	uint32_t time;
+	uint32_t lost;
+	LogLevel level;
+	char const* fmt;
+	int args[Log::MaxArgs];
+    };
+
+    // Several tasks and interrupt handlers may log on the same CPU,
+    // so slots are reserved with a compare-and-swap on 'head'. Only
+    // the formatter moves 'tail'. The indices are kept in separate
+    // cache lines since they're written by different parties.
+
+    struct Ring {
+	Atomic<uint32_t> head __attribute__((aligned(VWPP_CACHE_LINE)));
+	Atomic<uint32_t> dropped;
+	Atomic<uint32_t> tail __attribute__((aligned(VWPP_CACHE_LINE)));
+	Record rec[Log::RingSize];
+    };
+
+    Ring rings[VWPP_MAX_CPUS];
+    Atomic<uint32_t> totalDropped;
+
+    // Serializes the formatting task with flush().
+
+    Mutex logMtx;
+    int logFd = 2;
+
+    char const* const names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+    void drain(Ring& r)
+    {
+	uint32_t tail = r.tail.load(Relaxed);
+
+	while (true) {
+	    Record const& rec = r.rec[tail % Log::RingSize];
+
+	    if (rec.seq.load(Acquire) != tail + 1)
+		break;
+
+	    // Copy the record so its slot can be released before we
+	    // spend time formatting it.
+
+	    uint32_t const us = counts_to_us(rec.time);
+	    uint32_t const lost = rec.lost;
+	    LogLevel const level = rec.level;
+	    char const* const fmt = rec.fmt;
+	    int a[Log::MaxArgs];
+
+	    for (size_t ii = 0; ii < Log::MaxArgs; ++ii)
+		a[ii] = rec.args[ii];
+	    r.tail.store(++tail, Release);
+
+	    if (lost)
+		::fdprintf(logFd, "*** %u log records dropped\n", lost);
+	    ::fdprintf(logFd, "%4u.%06u %-5s ", us / 1000000, us % 1000000,
+		       names[level]);
+	    ::fdprintf(logFd, fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+	    ::fdprintf(logFd, "\n");
+	}
+    }
+
+    // The task which formats the records.
+
+    class Formatter : public Task {
+	int period;
+
+	void taskEntry()
+	{
+	    while (true) {
+		Log::flush();
+		delay(period);
+	    }
+	}
+
+     public:
+	Formatter() : period(100) {}
+	~Formatter() NOTHROW { kill(); }
+
+	void setPeriod(int const p) { period = p; }
+	void stop() NOTHROW { kill(); }
+    };
+
+    Formatter formatter;
+}
+
+// Reserves a slot in the current CPU's ring and fills it in. This
+// is safe to call from interrupt handlers.
+
+void Log::record(LogLevel const level, char const* const fmt, int const a1,
+		 int const a2, int const a3, int const a4, int const a5,
+		 int const a6) NOTHROW_IMPL
+{
+    Ring& r = rings[cpu_index()];
+    uint32_t idx = r.head.load(Relaxed);
+
+    do
+	if (UNLIKELY(idx - r.tail.load(Acquire) >= RingSize)) {
+	    r.dropped.fetch_add(1, Relaxed);
+	    totalDropped.fetch_add(1, Relaxed);
+	    return;
+	}
+    while (!r.head.compare_exchange(idx, idx + 1, Relaxed));
+
+    Record& rec = r.rec[idx % RingSize];
+
+    rec.time = read_timebase();
+    rec.level = level;
+    rec.fmt = fmt;
+    rec.args[0] = a1;
+    rec.args[1] = a2;
+    rec.args[2] = a3;
+    rec.args[3] = a4;
+    rec.args[4] = a5;
+    rec.args[5] = a6;
+    rec.lost = r.dropped.exchange(0, Relaxed);
+    rec.seq.store(idx + 1, Release);
+}
+
+void Log::start(int const fd, int const period, unsigned char const pri)
+{
+    {
+	Mutex::Lock<logMtx> lock;
+
+	logFd = fd;
+    }
+    formatter.setPeriod(period);
+    formatter.run("tVwppLog", pri, 8192);
+}
+
+void Log::stop() NOTHROW_IMPL
+{
+    formatter.stop();
+}
+
+// Records from different CPUs are written ring by ring, so they
+// may not be in time order.
+
+void Log::flush()
+{
+    Mutex::Lock<logMtx> lock;
+
+    for (size_t ii = 0; ii < VWPP_MAX_CPUS; ++ii)
+	drain(rings[ii]);
+}
+
+uint32_t Log::dropped() NOTHROW_IMPL
+{
+    return totalDropped.load(Relaxed);
+}
+
+// Called from the shell without an argument, 'fd' is 0 (the
+// shell's input), so anything below 1 selects stderr.
+
+STATUS vwppLogStart(int const fd)
+{
+    try {
+	Log::start(fd > 0 ? fd : 2);
+	return OK;
+    }
+    catch (std::exception& e) {
+	printf("vwppLogStart() : %s\n", e.what());
+	return ERROR;
+    }
+}
@@ -0,0 +1,357 @@
+#include <vxWorks.h>
+#include <taskLib.h>
+#include <taskInfo.h>
+#include <taskHookLib.h>
+#include <tickLib.h>
+#include <stdio.h>
+#include <stdexcept>
+#include "./vwpp_monitor.h"
+
+using namespace vwpp::v3_0;
+
+#ifndef _WRS_CONFIG_SMP
+extern "C" BOOL kernelIsIdle;
+#endif
+
+namespace {
+
+    // One closed window of statistics.
+
+    struct Window {
+	uint32_t ticks;
+	uint32_t total;
+	uint32_t switches;
+    };
+
+    // An entry of the task table. 'ticks' and 'switches' are
+    // updated by the hooks for the window that's currently open.
+
+    struct Entry {
+	int id;
+	uint32_t ticks;
+	uint32_t switches;
+	size_t stackSize;
+	size_t stackHigh;
+	size_t stackMargin;
+	Window win[TaskMonitor::Windows];
+    };
+
+    // Marks an entry whose task was removed. Lookups have to
+    // continue past these entries.
+
+    int const Removed = ERROR;
+
+    Entry table[TaskMonitor::MaxTasks];
+    uint32_t totalTicks;
+    uint32_t idleTicks;
+    Window idle[TaskMonitor::Windows];
+    size_t current;
+    size_t filled;
+    bool enabled;
+    bool hooksInstalled;
+
+    // Serializes the sampling task with the query functions.
+
+    Mutex monitorMtx;
+
+    inline size_t hash(int const id)
+    {
+	return (static_cast<unsigned>(id) >> 4) % TaskMonitor::MaxTasks;
+    }
+
+    // Finds the entry for a task. This is called from the hooks so
+    // it has to be quick and can't block.
+
+    Entry* lookup(int const id)
+    {
+	size_t idx = hash(id);
+
+	for (size_t ii = 0; ii < TaskMonitor::MaxTasks; ++ii) {
+	    Entry& e = table[idx];
+
+	    if (e.id == id)
+		return &e;
+	    if (!e.id)
+		break;
+	    idx = (idx + 1) % TaskMonitor::MaxTasks;
+	}
+	return 0;
+    }
+
+    // Called at interrupt level on every system clock tick. The
+    // tick is charged to the task that was interrupted.
+
+    void tickHook()
+    {
+	if (UNLIKELY(!enabled))
+	    return;
+
+	++totalTicks;
+
+#ifndef _WRS_CONFIG_SMP
+	if (kernelIsIdle) {
+	    ++idleTicks;
+	    return;
+	}
+#endif
+
+	Entry* const e = lookup(::taskIdSelf());
+
+	if (e)
+	    ++e->ticks;
+    }
+
+    // Called by the kernel on every context switch. In VxWorks, a
+    // task's ID is the address of its TCB.
+
+    void switchHook(WIND_TCB*, WIND_TCB* const newTcb)
+    {
+	if (UNLIKELY(!enabled))
+	    return;
+
+	Entry* const e = lookup(reinterpret_cast<long>(newTcb));
+
+	if (e)
+	    ++e->switches;
+    }
+
+    // Closes the current window and refreshes the stack usage.
+
+    void sample()
+    {
+	Mutex::Lock<monitorMtx> lock;
+
+	{
+	    IntLock iLock;
+
+	    for (size_t ii = 0; ii < TaskMonitor::MaxTasks; ++ii) {
+		Entry& e = table[ii];
+
+		if (e.id && e.id != Removed) {
+		    e.win[current].ticks = e.ticks;
+		    e.win[current].total = totalTicks;
+		    e.win[current].switches = e.switches;
+		}
+		e.ticks = 0;
+		e.switches = 0;
+	    }
+	    idle[current].ticks = idleTicks;
+	    idle[current].total = totalTicks;
+	    idle[current].switches = 0;
+	    idleTicks = 0;
+	    totalTicks = 0;
+	}
+
+	current = (current + 1) % TaskMonitor::Windows;
+	if (filled < TaskMonitor::Windows)
+	    ++filled;
+
+	for (size_t ii = 0; ii < TaskMonitor::MaxTasks; ++ii) {
+	    Entry& e = table[ii];
+	    TASK_DESC desc;
+
+	    if (e.id && e.id != Removed && OK == ::taskInfoGet(e.id, &desc)) {
+		e.stackSize = desc.td_stackSize;
+		e.stackHigh = desc.td_stackHigh;
+		e.stackMargin = desc.td_stackMargin;
+	    }
+	}
+    }
+
+    // Fills in the usage of an entry. The caller must own
+    // monitorMtx.
+
+    void fill(Entry const& e, TaskUsage& u)
+    {
+	size_t const last = (current + TaskMonitor::Windows - 1) %
+	    TaskMonitor::Windows;
+	uint32_t ticks = 0, total = 0;
+
+	u.id = e.id;
+	u.name = ::taskName(e.id);
+	u.switchesTotal = 0;
+	for (size_t ii = 0; ii < filled; ++ii) {
+	    ticks += e.win[ii].ticks;
+	    total += e.win[ii].total;
+	    u.switchesTotal += e.win[ii].switches;
+	}
+	u.cpuAverage = total ? (ticks * 1000) / total : 0;
+
+	if (filled) {
+	    Window const& w = e.win[last];
+
+	    u.cpuLast = w.total ? (w.ticks * 1000) / w.total : 0;
+	    u.switchesLast = w.switches;
+	} else {
+	    u.cpuLast = 0;
+	    u.switchesLast = 0;
+	}
+	u.stackSize = e.stackSize;
+	u.stackHigh = e.stackHigh;
+	u.stackMargin = e.stackMargin;
+    }
+
+    // The task which closes the windows.
+
+    class Sampler : public Task {
+	int period;
+
+	void taskEntry()
+	{
+	    while (true) {
+		delay(period);
+		sample();
+	    }
+	}
+
+     public:
+	Sampler() : period(1000) {}
+	~Sampler() NOTHROW { kill(); }
+
+	void setPeriod(int const p) { period = p; }
+	void stop() NOTHROW { kill(); }
+    };
+
+    Sampler sampler;
+}
+
+// Adds a task to the table. This is called by the task itself, as
+// it starts running. Windows that were closed before the task was
+// added count as idle for it.
+
+void TaskMonitor::attach(int const id) NOTHROW_IMPL
+{
+    IntLock lock;
+    size_t idx = hash(id);
+
+    for (size_t ii = 0; ii < MaxTasks; ++ii) {
+	Entry& e = table[idx];
+
+	if (!e.id || e.id == Removed) {
+	    e.id = id;
+	    e.ticks = e.switches = 0;
+	    e.stackSize = e.stackHigh = e.stackMargin = 0;
+	    for (size_t jj = 0; jj < Windows; ++jj) {
+		e.win[jj].ticks = e.win[jj].switches = 0;
+		e.win[jj].total = idle[jj].total;
+	    }
+	    return;
+	}
+	idx = (idx + 1) % MaxTasks;
+    }
+}
+
+void TaskMonitor::detach(int const id) NOTHROW_IMPL
+{
+    IntLock lock;
+    Entry* const e = lookup(id);
+
+    if (e)
+	e->id = Removed;
+}
+
+// Starts sampling. The hooks are installed the first time this is
+// called and are never removed; while the monitor is stopped, they
+// return right away.
+
+void TaskMonitor::start(int const period, unsigned char const pri)
+{
+    if (!hooksInstalled) {
+	if (ERROR == ::tickAnnounceHookAdd(reinterpret_cast<FUNCPTR>(tickHook)))
+	    throw std::runtime_error("couldn't add tick hook");
+	if (ERROR == ::taskSwitchHookAdd(reinterpret_cast<FUNCPTR>(switchHook)))
+	    throw std::runtime_error("couldn't add task switch hook");
+	hooksInstalled = true;
+    }
+
+    sampler.setPeriod(period);
+    sampler.run("tVwppMon", pri, 8192);
+    enabled = true;
+}
+
+void TaskMonitor::stop() NOTHROW_IMPL
+{
+    enabled = false;
+    sampler.stop();
+}
+
+bool TaskMonitor::query(Task const& task, TaskUsage& u)
+{
+    Mutex::Lock<monitorMtx> lock;
+    Entry const* const e = lookup(task.id);
+
+    if (e) {
+	fill(*e, u);
+	return true;
+    }
+    return false;
+}
+
+// Fills in the usage of up to 'n' tasks and returns the number of
+// entries used.
+
+size_t TaskMonitor::query(TaskUsage* const u, size_t const n)
+{
+    Mutex::Lock<monitorMtx> lock;
+    size_t total = 0;
+
+    for (size_t ii = 0; ii < MaxTasks && total < n; ++ii)
+	if (table[ii].id && table[ii].id != Removed)
+	    fill(table[ii], u[total++]);
+    return total;
+}
+
+void TaskMonitor::show()
+{
+    TaskUsage usage[MaxTasks];
+    size_t const n = query(usage, MaxTasks);
+
+    printf("%-16s %-10s %6s %6s %8s %8s %8s %8s\n", "NAME", "TID", "CPU%",
+	   "AVG%", "SWITCHES", "STACK", "HIGH", "MARGIN");
+    for (size_t ii = 0; ii < n; ++ii) {
+	TaskUsage const& u = usage[ii];
+
+	printf("%-16s 0x%08x %4u.%u %4u.%u %8u %8u %8u %8u\n",
+	       u.name ? u.name : "(deleted)", u.id,
+	       u.cpuLast / 10, u.cpuLast % 10,
+	       u.cpuAverage / 10, u.cpuAverage % 10,
+	       static_cast<unsigned>(u.switchesLast),
+	       static_cast<unsigned>(u.stackSize),
+	       static_cast<unsigned>(u.stackHigh),
+	       static_cast<unsigned>(u.stackMargin));
+    }
+
+    Mutex::Lock<monitorMtx> lock;
+
+    if (filled) {
+	Window const& w = idle[(current + Windows - 1) % Windows];
+
+	if (w.total)
+	    printf("idle: %u.%u%%\n", (w.ticks * 1000 / w.total) / 10,
+		   (w.ticks * 1000 / w.total) % 10);
+    }
+}
+
+STATUS vwppTaskMonitorStart(int const period)
+{
+    try {
+	TaskMonitor::start(period > 0 ? period : 1000);
+	return OK;
+    }
+    catch (std::exception& e) {
+	printf("vwppTaskMonitorStart() : %s\n", e.what());
+	return ERROR;
+    }
+}
+
+STATUS vwppTaskMonitorShow()
+{
+    try {
+	TaskMonitor::show();
+	return OK;
+    }
+    catch (std::exception& e) {
+	printf("vwppTaskMonitorShow() : %s\n", e.what());
+	return ERROR;
+    }
+}
@@ -1,7 +1,9 @@
 #include <vxWorks.h>
 #include <msgQLib.h>
+#include <semLib.h>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
 #include "./vwpp.h"
 
 using namespace vwpp::v3_0;
@@ -35,6 +37,34 @@ static void xlatErrno(int e)
     }
 }
 
+// Translates errno into a Status for the non-throwing functions.
+
+static Status toStatus(int e)
+{
+    switch (e) {
+     case S_objLib_OBJ_ID_ERROR:
+	return BadHandle;
+
+     case S_objLib_OBJ_DELETED:
+	return Deleted;
+
+     case S_objLib_OBJ_UNAVAILABLE:
+	return Unavailable;
+
+     case S_objLib_OBJ_TIMEOUT:
+	return Timeout;
+
+     case S_msgQLib_INVALID_MSG_LENGTH:
+	return BadLength;
+
+     case S_msgQLib_NON_ZERO_TIMEOUT_AT_INT_LEVEL:
+	return NotIsrCallable;
+
+     default:
+	return Failure;
+    }
+}
+
 QueueBase::QueueBase(size_t sz, size_t nn) :
     id(::msgQCreate(nn, sz, MSG_Q_PRIORITY))
 {
@@ -59,9 +89,13 @@ size_t QueueBase::total() const
 
 bool QueueBase::_pop_front(void* buf, size_t nn, int tmo)
 {
+    trace::event(trace::QueueReceive, trace::Begin, id);
+
     int const result = ::msgQReceive(id, reinterpret_cast<char*>(buf), nn,
 				     ms_to_tick(tmo));
 
+    trace::event(trace::QueueReceive, trace::End, id);
+
     if (LIKELY(ERROR != result)) {
 	if ((size_t) result < nn)
 	    throw std::logic_error("too little data pulled from queue");
@@ -73,15 +107,20 @@ bool QueueBase::_pop_front(void* buf, size_t nn, int tmo)
 
 bool QueueBase::_msg_send(void const* buf, size_t nn, int tmo, int pri)
 {
+    trace::event(trace::QueueSend, trace::Begin, id);
+
     int const result =
 	::msgQSend(id, const_cast<char*>(reinterpret_cast<char const*>(buf)),
 		   nn, ms_to_tick(tmo), pri);
 
-    if (LIKELY(ERROR != result)) {
-	if ((size_t) result < nn)
-	    throw std::logic_error("too little data sent to queue");
+    trace::event(trace::QueueSend, trace::End, id);
+
+    // msgQSend() returns OK, not a length; it sends all of the
+    // message or none of it.
+
+    if (LIKELY(ERROR != result))
 	return true;
-    } else if (UNLIKELY(errno != S_objLib_OBJ_TIMEOUT))
+    else if (UNLIKELY(errno != S_objLib_OBJ_TIMEOUT))
 	xlatErrno(errno);
     return false;
 }
@@ -95,3 +134,590 @@ bool QueueBase::_push_back(void const* buf, size_t nn, int tmo)
 {
     return _msg_send(buf, nn, tmo, MSG_PRI_NORMAL);
 }
+
+Status QueueBase::_try_pop_front(void* buf, size_t nn, int tmo) NOTHROW_IMPL
+{
+    trace::event(trace::QueueReceive, trace::Begin, id);
+
+    int const result = ::msgQReceive(id, reinterpret_cast<char*>(buf), nn,
+				     ms_to_tick(tmo));
+
+    trace::event(trace::QueueReceive, trace::End, id);
+
+    if (LIKELY(ERROR != result))
+	return (size_t) result < nn ? BadLength : Success;
+    return toStatus(errno);
+}
+
+Status QueueBase::_try_msg_send(void const* buf, size_t nn, int tmo,
+				int pri) NOTHROW_IMPL
+{
+    trace::event(trace::QueueSend, trace::Begin, id);
+
+    int const result =
+	::msgQSend(id, const_cast<char*>(reinterpret_cast<char const*>(buf)),
+		   nn, ms_to_tick(tmo), pri);
+
+    trace::event(trace::QueueSend, trace::End, id);
+
+    // As in _msg_send(), a successful msgQSend() returns OK.
+
+    if (LIKELY(ERROR != result))
+	return Success;
+    return toStatus(errno);
+}
+
+Status QueueBase::_try_push_front(void const* buf, size_t nn,
+				  int tmo) NOTHROW_IMPL
+{
+    return _try_msg_send(buf, nn, tmo, MSG_PRI_URGENT);
+}
+
+Status QueueBase::_try_push_back(void const* buf, size_t nn,
+				 int tmo) NOTHROW_IMPL
+{
+    return _try_msg_send(buf, nn, tmo, MSG_PRI_NORMAL);
+}
+
+ObjectQueueBase::ObjectQueueBase(size_t const nn) :
+    access(::semMCreate(SEM_Q_PRIORITY | SEM_DELETE_SAFE |
+			SEM_INVERSION_SAFE)),
+    freeSlots(::semCCreate(SEM_Q_PRIORITY, nn)),
+    usedSlots(::semCCreate(SEM_Q_PRIORITY, 0)),
+    nSlots(nn), head(0), used(0)
+{
+    if (UNLIKELY(!access || !freeSlots || !usedSlots)) {
+	if (access)
+	    ::semDelete(access);
+	if (freeSlots)
+	    ::semDelete(freeSlots);
+	if (usedSlots)
+	    ::semDelete(usedSlots);
+	throw std::bad_alloc();
+    }
+}
+
+ObjectQueueBase::~ObjectQueueBase() NOTHROW_IMPL
+{
+    ::semDelete(usedSlots);
+    ::semDelete(freeSlots);
+    ::semDelete(access);
+}
+
+// Waits for a free slot and locks the queue. On success, 'idx' holds
+// the slot in which the caller must construct the new element. The
+// caller must then call _commit() to add it to the queue, or
+// _cancel() to give the slot back.
+
+Status ObjectQueueBase::_reserve(bool const front, int const tmo,
+				 size_t& idx) NOTHROW_IMPL
+{
+    if (UNLIKELY(ERROR == ::semTake(freeSlots, ms_to_tick(tmo))))
+	return toStatus(errno);
+
+    if (UNLIKELY(ERROR == ::semTake(access, WAIT_FOREVER))) {
+	Status const st = toStatus(errno);
+
+	::semGive(freeSlots);
+	return st;
+    }
+
+    idx = front ? (head + nSlots - 1) % nSlots : (head + used) % nSlots;
+    return Success;
+}
+
+void ObjectQueueBase::_commit(bool const front) NOTHROW_IMPL
+{
+    if (front)
+	head = (head + nSlots - 1) % nSlots;
+    ++used;
+    ::semGive(access);
+    ::semGive(usedSlots);
+}
+
+void ObjectQueueBase::_cancel() NOTHROW_IMPL
+{
+    ::semGive(access);
+    ::semGive(freeSlots);
+}
+
+// Waits for an element to be available and locks the queue. On
+// success, 'idx' holds the slot of the element at the front of the
+// queue. The caller must call _consume() after destroying it.
+
+Status ObjectQueueBase::_claim(int const tmo, size_t& idx) NOTHROW_IMPL
+{
+    if (UNLIKELY(ERROR == ::semTake(usedSlots, ms_to_tick(tmo))))
+	return toStatus(errno);
+
+    if (UNLIKELY(ERROR == ::semTake(access, WAIT_FOREVER))) {
+	Status const st = toStatus(errno);
+
+	::semGive(usedSlots);
+	return st;
+    }
+
+    idx = head;
+    return Success;
+}
+
+void ObjectQueueBase::_consume() NOTHROW_IMPL
+{
+    head = (head + 1) % nSlots;
+    --used;
+    ::semGive(access);
+    ::semGive(freeSlots);
+}
+
+PriorityQueueBase::PriorityQueueBase() :
+    access(::semMCreate(SEM_Q_PRIORITY | SEM_DELETE_SAFE |
+			SEM_INVERSION_SAFE)),
+    usedSlots(::semCCreate(SEM_Q_PRIORITY, 0)),
+    levels(0), nLevels(0), nSlots(0), elemSize(0), storage(0), ready(0)
+{
+    if (UNLIKELY(!access || !usedSlots)) {
+	if (access)
+	    ::semDelete(access);
+	if (usedSlots)
+	    ::semDelete(usedSlots);
+	throw std::bad_alloc();
+    }
+}
+
+// Called by the constructor of PriorityQueue<> to hand over its
+// storage. If the semaphores for every level can't be created, the
+// destructor will clean up the ones that were.
+
+void PriorityQueueBase::_init(Level* const lvl, size_t const nl,
+			      size_t const nn, void* const buf,
+			      size_t const sz)
+{
+    levels = lvl;
+    nSlots = nn;
+    elemSize = sz;
+    storage = reinterpret_cast<uint8_t*>(buf);
+
+    for (nLevels = 0; nLevels < nl; ++nLevels) {
+	Level& ll = levels[nLevels];
+
+	if (UNLIKELY(!(ll.freeSlots = ::semCCreate(SEM_Q_PRIORITY, nn))))
+	    throw std::bad_alloc();
+	ll.head = ll.used = 0;
+	ll.pushed = ll.timeouts = 0;
+    }
+}
+
+PriorityQueueBase::~PriorityQueueBase() NOTHROW_IMPL
+{
+    for (size_t ii = 0; ii < nLevels; ++ii)
+	::semDelete(levels[ii].freeSlots);
+    ::semDelete(usedSlots);
+    ::semDelete(access);
+}
+
+PriorityQueueBase::Level const& PriorityQueueBase::_level(size_t const ll) const
+{
+    if (LIKELY(ll < nLevels))
+	return levels[ll];
+    throw std::out_of_range("queue priority level out of range");
+}
+
+size_t PriorityQueueBase::total() const NOTHROW_IMPL
+{
+    size_t total = 0;
+
+    for (size_t ii = 0; ii < nLevels; ++ii)
+	total += levels[ii].used;
+    return total;
+}
+
+// Adds an element to the end of the given level. The 'ready' bitmap
+// uses bit 31 for level 0 so the highest priority, non-empty level
+// can be found by counting leading zeroes.
+
+Status PriorityQueueBase::_push(size_t const ll, void const* const buf,
+				int const tmo) NOTHROW_IMPL
+{
+    if (UNLIKELY(ll >= nLevels))
+	return OutOfRange;
+
+    Level& lvl = levels[ll];
+
+    if (UNLIKELY(ERROR == ::semTake(lvl.freeSlots, ms_to_tick(tmo)))) {
+	Status const st = toStatus(errno);
+
+	if (Timeout == st)
+	    ++lvl.timeouts;
+	return st;
+    }
+
+    if (UNLIKELY(ERROR == ::semTake(access, WAIT_FOREVER))) {
+	Status const st = toStatus(errno);
+
+	::semGive(lvl.freeSlots);
+	return st;
+    }
+
+    size_t const idx = ll * nSlots + (lvl.head + lvl.used) % nSlots;
+
+    memcpy(storage + idx * elemSize, buf, elemSize);
+    ++lvl.used;
+    ++lvl.pushed;
+    ready |= 0x80000000u >> ll;
+    ::semGive(access);
+    ::semGive(usedSlots);
+    return Success;
+}
+
+// Removes the oldest element of the highest priority, non-empty
+// level.
+
+Status PriorityQueueBase::_pop(void* const buf, int const tmo,
+			       size_t* const lvlOut) NOTHROW_IMPL
+{
+    if (UNLIKELY(ERROR == ::semTake(usedSlots, ms_to_tick(tmo))))
+	return toStatus(errno);
+
+    if (UNLIKELY(ERROR == ::semTake(access, WAIT_FOREVER))) {
+	Status const st = toStatus(errno);
+
+	::semGive(usedSlots);
+	return st;
+    }
+
+    size_t const ll = __builtin_clz(ready);
+    Level& lvl = levels[ll];
+
+    memcpy(buf, storage + (ll * nSlots + lvl.head) * elemSize, elemSize);
+    lvl.head = (lvl.head + 1) % nSlots;
+    if (!--lvl.used)
+	ready &= ~(0x80000000u >> ll);
+    ::semGive(access);
+    ::semGive(lvl.freeSlots);
+
+    if (lvlOut)
+	*lvlOut = ll;
+    return Success;
+}
+
+// Throws the exception associated with the status returned by one
+// of the non-throwing queue functions.
+
+void QueueStatus::_raise(Status const st)
+{
+    switch (st) {
+     case BadHandle:
+	throw std::logic_error("invalid queue semaphore");
+
+     case Deleted:
+	throw std::logic_error("queue has been deleted");
+
+     case Unavailable:
+	throw std::logic_error("queue is unavailable");
+
+     case Timeout:
+	throw std::runtime_error("time expired waiting for queue data");
+
+     case NotIsrCallable:
+	throw std::logic_error("queue used in interrupt handler");
+
+     case BadLength:
+	throw std::logic_error("bad message length specified");
+
+     case OutOfRange:
+	throw std::out_of_range("queue priority level out of range");
+
+     default:
+	throw std::logic_error("returned an unsupported error code");
+    }
+}
+
+#ifndef NDEBUG
+
+#include <sysLib.h>
+#include <taskLib.h>
+#include <tickLib.h>
+#include <algorithm>
+#include <iostream>
+
+extern "C" {
+    STATUS vwppTestQueues();
+    STATUS vwppTestLatestValue();
+    STATUS vwppTestBroadcast();
+}
+
+namespace {
+
+    void check(bool const cond, char const* const what)
+    {
+	if (UNLIKELY(!cond))
+	    throw std::runtime_error(what);
+    }
+}
+
+// Regression test for the non-throwing queue operations. It must be
+// run by a task.
+
+STATUS vwppTestQueues()
+{
+    try {
+	Queue<int, 4> q;
+	int v = 0;
+
+	check(Success == q.try_push_back(5, 0), "try_push_back() failed");
+	check(Success == q.try_push_front(4, 0), "try_push_front() failed");
+	check(Success == q.try_pop_front(v, 0) && 4 == v,
+	      "try_pop_front() didn't return the urgent message");
+	check(Success == q.try_pop_front(v, 0) && 5 == v,
+	      "try_pop_front() didn't return the normal message");
+	check(Success != q.try_pop_front(v, 0),
+	      "try_pop_front() returned a message from an empty queue");
+
+	for (int ii = 0; ii < 4; ++ii)
+	    check(Success == q.try_push_back(ii, 0), "couldn't fill the queue");
+	check(Success != q.try_push_back(4, 0), "pushed onto a full queue");
+	for (int ii = 0; ii < 4; ++ii)
+	    check(Success == q.try_pop_front(v, 0) && ii == v,
+		  "messages came out of order");
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestQueues() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+namespace {
+
+    // A snapshot large enough that the writer is likely to be
+    // preempted while copying one. Every word is derived from the
+    // sequence number, so a torn copy is noticed.
+
+    struct Snapshot {
+	enum { Words = 64 };
+
+	uint32_t seq;
+	uint32_t word[Words];
+
+	void fill(uint32_t const s)
+	{
+	    seq = s;
+	    for (size_t ii = 0; ii < Words; ++ii)
+		word[ii] = s * (ii + 1);
+	}
+
+	bool intact() const
+	{
+	    for (size_t ii = 0; ii < Words; ++ii)
+		if (word[ii] != seq * (ii + 1))
+		    return false;
+	    return true;
+	}
+    };
+
+    // Publishes snapshots until it's told to stop, and then
+    // reports the sequence number of the last one.
+
+    class SnapshotWriter : public Task {
+	LatestValue<Snapshot>& lv;
+
+	void taskEntry()
+	{
+	    Snapshot tmp;
+	    uint32_t seq = 0;
+
+	    while (running) {
+		tmp.fill(++seq);
+		lv.publish(tmp);
+	    }
+	    last.store(seq, Release);
+	}
+
+     public:
+	bool volatile running;
+	Atomic<uint32_t> last;
+
+	explicit SnapshotWriter(LatestValue<Snapshot>& l) :
+	    lv(l), running(true), last(0)
+	{}
+
+	~SnapshotWriter() NOTHROW { kill(); }
+    };
+}
+
+// Regression test for LatestValue<>. A lower priority writer task
+// publishes snapshots as fast as it can while this task, waking on
+// every clock tick, reads them. The reader must never see a torn
+// snapshot or an older one than it already saw, and must end up
+// with the last one. It must be run by a task.
+
+STATUS vwppTestLatestValue()
+{
+    try {
+	LatestValue<Snapshot> lv;
+	SnapshotWriter writer(lv);
+	Snapshot v;
+	uint32_t last = 0;
+	int pri;
+
+	check(!lv.update(), "nothing was published yet");
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	writer.run("tTestLatest", std::min(pri + 10, 255), 8192);
+
+	for (int tick = 0; tick < 200; ++tick) {
+	    ::taskDelay(1);
+	    for (int ii = 0; ii < 10; ++ii) {
+		bool const fresh = lv.read(v);
+
+		if (!fresh && !last)
+		    continue;
+		check(v.intact(), "read a torn snapshot");
+		check(fresh ? v.seq > last : v.seq == last,
+		      fresh ? "read an old snapshot" :
+		      "snapshot changed without being published");
+		last = v.seq;
+	    }
+	}
+	check(last > 0, "the writer never ran");
+
+	writer.running = false;
+	for (int tick = 0; !writer.last.load(Acquire); ++tick) {
+	    check(tick < 1000, "the writer didn't stop");
+	    ::taskDelay(1);
+	}
+	// The last snapshot may have been read already, so only
+	// its value is checked.
+
+	lv.read(v);
+	check(v.intact() && v.seq == writer.last.load(Relaxed),
+	      "didn't get the last snapshot");
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestLatestValue() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+
+namespace {
+
+    struct Message {
+	uint32_t seq;
+	uint32_t check;
+    };
+
+    typedef Broadcast<Message, 16> Channel;
+
+    class Publisher : public Task {
+	Channel& ch;
+
+	void taskEntry()
+	{
+	    for (uint32_t seq = 0; seq < Count; ++seq) {
+		Message const m = { seq, ~seq };
+
+		ch.publish(m);
+	    }
+	}
+
+     public:
+	enum { Count = 10000 };
+
+	explicit Publisher(Channel& c) : ch(c) {}
+	~Publisher() NOTHROW { kill(); }
+    };
+
+    // Keeps track of the messages one subscriber received. They
+    // have to be intact and in order; the ones skipped have to be
+    // accounted for by overruns().
+
+    struct Tally {
+	uint32_t next;
+	uint32_t received;
+
+	Tally() : next(0), received(0) {}
+
+	void got(Message const& m)
+	{
+	    check(m.check == ~m.seq, "received a corrupt message");
+	    check(m.seq >= next, "received a message out of order");
+	    next = m.seq + 1;
+	    ++received;
+	}
+
+	void verify(Channel::Subscriber const& sub) const
+	{
+	    check(next == Publisher::Count, "missed the last message");
+	    check(received + sub.overruns() == Publisher::Count,
+		  "lost messages that weren't counted as overruns");
+	}
+    };
+}
+
+// Regression test for Broadcast<>. A subscriber that falls more than
+// a ring's worth behind has to lose exactly the messages it reports
+// as overruns. It must be run by a task.
+
+STATUS vwppTestBroadcast()
+{
+    try {
+	Channel ch;
+	Message m;
+
+	// Publish more than the ring holds before reading. The
+	// subscriber gets the newest nn - 1 messages.
+
+	{
+	    Channel::Subscriber sub(ch);
+
+	    for (uint32_t seq = 0; seq < 100; ++seq) {
+		Message const tmp = { seq, ~seq };
+
+		ch.publish(tmp);
+	    }
+	    check(100 == sub.lag(), "wrong lag");
+	    for (uint32_t seq = 85; seq < 100; ++seq)
+		check(sub.receive(m, 0) && m.seq == seq,
+		      "didn't receive the newest messages");
+	    check(Timeout == sub.try_receive(m, 0),
+		  "received more messages than were kept");
+	    check(85 == sub.overruns(), "wrong overrun count");
+	}
+
+	// A lower priority task publishes while this task reads
+	// every message for a fast subscriber and only every eighth
+	// one for a slow subscriber.
+
+	Channel::Subscriber fast(ch);
+	Channel::Subscriber slow(ch);
+	Publisher pub(ch);
+	Tally fastTally, slowTally;
+	int pri;
+
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	pub.run("tTestBcast", std::min(pri + 10, 255), 8192);
+
+	for (uint32_t ii = 0; fastTally.next < Publisher::Count; ++ii) {
+	    check(fast.receive(m, 1000), "the publisher stalled");
+	    fastTally.got(m);
+	    if (0 == ii % 8 && slow.receive(m, 0))
+		slowTally.got(m);
+	}
+	while (slow.receive(m, 0))
+	    slowTally.got(m);
+
+	fastTally.verify(fast);
+	slowTally.verify(slow);
+	check(slow.overruns() > 0, "the slow subscriber didn't fall behind");
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestBroadcast() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include <vxWorks.h>
+#include <eventLib.h>
+#include <semLib.h>
+#include <semEvLib.h>
+#include <msgQLib.h>
+#include <msgQEvLib.h>
+#include <taskLib.h>
+#include <stdexcept>
+#include "./vwpp.h"
+
+using namespace vwpp::v3_0;
+
+Selector::Selector(bool const f) :
+    owner(::taskIdSelf()), fair(f), next(0), allocated(0), pending(0),
+    queues(0)
+{
+    for (size_t ii = 0; ii < MaxSources; ++ii) {
+	src[ii].kind = Unused;
+	src[ii].obj = 0;
+    }
+}
+
+// Unregisters all the sources. Any of their events that were sent,
+// but not received, are discarded so they don't confuse a later
+// Selector created by the same task.
+
+Selector::~Selector() NOTHROW_IMPL
+{
+    for (size_t ii = 0; ii < MaxSources; ++ii)
+	if (Unused != src[ii].kind)
+	    remove(ii);
+}
+
+// Finds an unused event bit and records the source using it.
+
+size_t Selector::allocate(Kind const kind, void* const obj)
+{
+    if (UNLIKELY(::taskIdSelf() != owner))
+	throw std::logic_error("only the owner can add selector sources");
+
+    for (size_t ii = 0; ii < MaxSources; ++ii)
+	if (Unused == src[ii].kind) {
+	    src[ii].kind = kind;
+	    src[ii].obj = obj;
+	    allocated |= 1u << ii;
+	    return ii;
+	}
+    throw std::runtime_error("too many selector sources");
+}
+
+// Registers an event. Selecting the event makes it signal through
+// its semaphore, and EVENTS_SEND_IF_FREE makes the kernel send the
+// event right away if the event is already signalled.
+
+size_t Selector::addEvent(EventBase& ev)
+{
+    size_t const idx = allocate(EventSource, &ev);
+
+    ev.select(true);
+    if (UNLIKELY(ERROR == ::semEvStart(ev.id, 1u << idx,
+				       EVENTS_SEND_IF_FREE))) {
+	ev.select(false);
+	src[idx].kind = Unused;
+	allocated &= ~(1u << idx);
+	throw std::logic_error("event is already registered with a "
+			       "selector");
+    }
+    return idx;
+}
+
+size_t Selector::add(QueueBase& q)
+{
+    size_t const idx = allocate(QueueSource, q.id);
+
+    if (UNLIKELY(ERROR == ::msgQEvStart(q.id, 1u << idx,
+					EVENTS_SEND_IF_FREE))) {
+	src[idx].kind = Unused;
+	allocated &= ~(1u << idx);
+	throw std::logic_error("queue is already registered with a "
+			       "selector");
+    }
+    queues |= 1u << idx;
+    return idx;
+}
+
+size_t Selector::addFlag()
+{
+    return allocate(FlagSource, 0);
+}
+
+void Selector::remove(size_t const idx)
+{
+    if (UNLIKELY(idx >= MaxSources || Unused == src[idx].kind))
+	return;
+
+    uint32_t const mask = 1u << idx;
+
+    switch (src[idx].kind) {
+     case EventSource:
+	{
+	    EventBase* const ev = static_cast<EventBase*>(src[idx].obj);
+
+	    ::semEvStop(ev->id);
+	    ev->select(false);
+	}
+	break;
+
+     case QueueSource:
+	::msgQEvStop(static_cast<MSG_Q_ID>(src[idx].obj));
+	break;
+
+     default:
+	break;
+    }
+
+    UINT32 discard;
+
+    ::eventReceive(mask, EVENTS_WAIT_ANY, NO_WAIT, &discard);
+    src[idx].kind = Unused;
+    src[idx].obj = 0;
+    allocated &= ~mask;
+    pending &= ~mask;
+    queues &= ~mask;
+}
+
+// Marks a flag source as ready. This may be called from any task or
+// from an interrupt handler.
+
+void Selector::signal(size_t const idx) const NOTHROW_IMPL
+{
+    ::eventSend(owner, 1u << idx);
+}
+
+// Adds the events that have arrived to the set of pending sources.
+// Queues are only reported when a message arrives, so any queue
+// that was previously reported, and still holds messages, is marked
+// as pending without waiting.
+
+void Selector::collect(int const tmo)
+{
+    if (UNLIKELY(::taskIdSelf() != owner))
+	throw std::logic_error("only the owner can wait on a selector");
+
+    for (uint32_t qs = queues & ~pending; qs; qs &= qs - 1) {
+	size_t const idx = 31 - __builtin_clz(qs & -qs);
+
+	if (::msgQNumMsgs(static_cast<MSG_Q_ID>(src[idx].obj)) > 0)
+	    pending |= 1u << idx;
+    }
+
+    UINT32 events = 0;
+
+    if (ERROR == ::eventReceive(allocated, EVENTS_WAIT_ANY,
+				pending ? NO_WAIT : ms_to_tick(tmo),
+				&events))
+	switch (errno) {
+	 case S_eventLib_TIMEOUT:
+	 case S_eventLib_NOT_ALL_EVENTS:
+	    break;
+
+	 default:
+	    throw std::logic_error("couldn't receive selector events");
+	}
+    pending |= events & allocated;
+}
+
+uint32_t Selector::wait(int const tmo)
+{
+    collect(tmo);
+
+    uint32_t const result = pending;
+
+    pending = 0;
+    return result;
+}
+
+int Selector::waitOne(int const tmo)
+{
+    if (!pending)
+	collect(tmo);
+    if (!pending)
+	return -1;
+
+    // Rotate the pending mask so the search starts at 'next'.
+    // Without fairness, 'next' is always 0.
+
+    uint32_t const rot = fair ?
+	((pending >> next) | (pending << (MaxSources - next))) &
+	((1u << MaxSources) - 1) : pending;
+    size_t const idx = (31 - __builtin_clz(rot & -rot) + next) % MaxSources;
+
+    pending &= ~(1u << idx);
+    if (fair)
+	next = (idx + 1) % MaxSources;
+    return static_cast<int>(idx);
+}
@@ -1,10 +1,38 @@
 #include <vxWorks.h>
 #include <intLib.h>
 #include <semLib.h>
+#include <sysLib.h>
+#include <taskLib.h>
+#include <tickLib.h>
 #include "./vwpp.h"
 
 using namespace vwpp::v3_0;
 
+// Translates the errno value of a failed semTake() into a Status.
+
+static Status xlatErrno(int const e)
+{
+    switch (e) {
+     case S_intLib_NOT_ISR_CALLABLE:
+	return NotIsrCallable;
+
+     case S_objLib_OBJ_ID_ERROR:
+	return BadHandle;
+
+     case S_objLib_OBJ_UNAVAILABLE:
+	return Unavailable;
+
+     case S_objLib_OBJ_DELETED:
+	return Deleted;
+
+     case S_objLib_OBJ_TIMEOUT:
+	return Timeout;
+
+     default:
+	return Failure;
+    }
+}
+
 Mutex::Mutex() :
     SemaphoreBase(::semMCreate(SEM_Q_PRIORITY | SEM_DELETE_SAFE |
 			       SEM_INVERSION_SAFE))
@@ -13,7 +41,12 @@ Mutex::Mutex() :
 
 void SemaphoreBase::acquire(int tmo)
 {
-    if (UNLIKELY(ERROR == ::semTake(res, ms_to_tick(tmo))))
+    trace::event(trace::SemAcquire, trace::Begin, res);
+
+    STATUS const result = ::semTake(res, ms_to_tick(tmo));
+
+    trace::event(trace::SemAcquire, trace::End, res);
+    if (UNLIKELY(ERROR == result))
 	switch (errno) {
 	 case S_intLib_NOT_ISR_CALLABLE:
 	    throw std::logic_error("couldn't lock semaphore -- inside "
@@ -34,8 +67,111 @@ void SemaphoreBase::acquire(int tmo)
 	}
 }
 
+// Non-throwing version of acquire(). Rather than throwing an
+// exception, the reason for failing is returned.
+
+Status SemaphoreBase::try_acquire(int tmo) NOTHROW_IMPL
+{
+    trace::event(trace::SemAcquire, trace::Begin, res);
+
+    STATUS const result = ::semTake(res, ms_to_tick(tmo));
+
+    trace::event(trace::SemAcquire, trace::End, res);
+    if (LIKELY(OK == result))
+	return Success;
+    return xlatErrno(errno);
+}
+
+CountingSemaphore::CountingSemaphore(uint32_t const initial) :
+    SemaphoreBase(::semBCreate(SEM_Q_PRIORITY, SEM_EMPTY)), avail(initial),
+    waiters(0)
+{
+}
+
+// The base class destructor takes the semaphore before deleting it,
+// so it has to be full.
+
+CountingSemaphore::~CountingSemaphore() NOTHROW_IMPL
+{
+    SemaphoreBase::release();
+}
+
+void CountingSemaphore::acquire(uint32_t const n, int const tmo)
+{
+    switch (try_acquire(n, tmo)) {
+     case Success:
+	break;
+
+     case Timeout:
+	throw timeout_error();
+
+     case NotIsrCallable:
+	throw std::logic_error("couldn't acquire semaphore -- inside "
+			       "interrupt!");
+
+     default:
+	throw std::logic_error("couldn't acquire semaphore");
+    }
+}
+
+// Takes 'n' units, waiting up to 'tmo' milliseconds for them. The
+// count is checked, and the task blocks, with interrupts locked so a
+// release can't slip in between the two.
+
+Status CountingSemaphore::try_acquire(uint32_t const n,
+				      int const tmo) NOTHROW_IMPL
+{
+    if (LIKELY(take(n)))
+	return Success;
+    if (!tmo)
+	return Timeout;
+    if (UNLIKELY(::intContext()))
+	return NotIsrCallable;
+
+    unsigned long const start = ::tickGet();
+    IntLock lock;
+    Status result;
+
+    waiters.fetch_add(1, Relaxed);
+    while (true) {
+	if (take(n)) {
+	    result = Success;
+	    break;
+	}
+
+	int remaining = -1;
+
+	if (tmo >= 0) {
+	    int const elapsed = (::tickGet() - start) * 1000 /
+		::sysClkRateGet();
+
+	    if (elapsed >= tmo) {
+		result = Timeout;
+		break;
+	    }
+	    remaining = tmo - elapsed;
+	}
+
+	// A timeout ends the loop on the next pass, after the count
+	// has been checked one last time.
+
+	result = SemaphoreBase::try_acquire(remaining);
+	if (Success != result && Timeout != result)
+	    break;
+    }
+    waiters.fetch_sub(1, Relaxed);
+    return result;
+}
+
+void CountingSemaphore::release(uint32_t const n) NOTHROW_IMPL
+{
+    avail.fetch_add(n, Release);
+    if (waiters.load(Acquire))
+	flush();
+}
+
 EventBase::EventBase() :
-    id(::semBCreate(SEM_Q_PRIORITY, SEM_EMPTY))
+    id(::semBCreate(SEM_Q_PRIORITY, SEM_EMPTY)), state(0), flushes(0)
 {
     if (UNLIKELY(!id))
 	throw std::bad_alloc();
@@ -46,15 +182,92 @@ EventBase::~EventBase() NOTHROW_IMPL
     ::semDelete(id);
 }
 
+// Called as a task starts waiting. If a signal is pending, it gets
+// consumed and true is returned. Otherwise the task is counted as a
+// waiter, so signals go through the semaphore until it leaves.
+
+bool EventBase::enter() NOTHROW_IMPL
+{
+    uint32_t s = state.load(Relaxed);
+
+    while (true)
+	if (s & Pending) {
+	    if (state.compare_exchange(s, s & ~Pending, Acquire))
+		return true;
+	} else if (state.compare_exchange(s, s + 1, Acquire))
+	    return false;
+}
+
+// Called as a waiting task returns. When the last waiter leaves, a
+// signal that reached the semaphore after the waiter woke up (or
+// timed out) is moved to the pending flag, which keeps the semaphore
+// empty while nobody waits.
+
+void EventBase::leave() NOTHROW_IMPL
+{
+    IntLock lock;
+
+    if ((state.fetch_sub(1, AcqRel) & (Waiters | Selected)) == 1 &&
+	OK == ::semTake(id, NO_WAIT))
+	state.fetch_or(Pending, Release);
+}
+
+// The slow path of wakeOne(). The state is checked again with
+// interrupts locked since the last waiter may have left.
+
+void EventBase::give() NOTHROW_IMPL
+{
+    IntLock lock;
+
+    if (state.load(Acquire) & (Waiters | Selected))
+	::semGive(id);
+    else
+	state.fetch_or(Pending, Release);
+}
+
+// Called by a Selector as it starts or stops watching the event. A
+// pending signal is moved to the semaphore, and back, so the
+// Selector sees it.
+
+void EventBase::select(bool const on) NOTHROW_IMPL
+{
+    IntLock lock;
+
+    if (on) {
+	if (state.fetch_or(Selected, AcqRel) & Pending) {
+	    state.fetch_and(~Pending, Relaxed);
+	    ::semGive(id);
+	}
+    } else if (!(state.fetch_and(~Selected, AcqRel) & Waiters) &&
+	       OK == ::semTake(id, NO_WAIT))
+	state.fetch_or(Pending, Release);
+}
+
 // Wait for an event to occur. The caller will be blocked until it
 // gets signalled (by another task calling wakeOne() or wakeAll()) or
 // until the timeout occurs. If the function is terminated by a
-// timeout, it returns false, otherwise it returns true.
+// timeout, it returns false, otherwise it returns true. A signal
+// that's already pending is consumed without entering the kernel.
 
 bool EventBase::_wait(int tmo)
 {
-    if (UNLIKELY(ERROR == ::semTake(id, ms_to_tick(tmo))))
-	switch (errno) {
+    if (UNLIKELY(::intContext()))
+	return false;
+
+    trace::event(trace::EventWait, trace::Begin, id);
+
+    if (enter()) {
+	trace::event(trace::EventWait, trace::End, id);
+	return true;
+    }
+
+    STATUS const result = ::semTake(id, ms_to_tick(tmo));
+    int const err = errno;
+
+    leave();
+    trace::event(trace::EventWait, trace::End, id);
+    if (UNLIKELY(ERROR == result))
+	switch (err) {
 	 case S_intLib_NOT_ISR_CALLABLE:
 	 case S_objLib_OBJ_TIMEOUT:
 	    return false;
@@ -72,12 +285,42 @@ bool EventBase::_wait(int tmo)
     return true;
 }
 
+// Non-throwing version of _wait(). Returns Success if the event was
+// signalled. Unlike _wait(), calling this from an interrupt handler
+// is reported as NotIsrCallable rather than as a timeout.
+
+Status EventBase::_try_wait(int tmo) NOTHROW_IMPL
+{
+    if (UNLIKELY(::intContext()))
+	return NotIsrCallable;
+
+    trace::event(trace::EventWait, trace::Begin, id);
+
+    if (enter()) {
+	trace::event(trace::EventWait, trace::End, id);
+	return Success;
+    }
+
+    STATUS const result = ::semTake(id, ms_to_tick(tmo));
+    int const err = errno;
+
+    leave();
+    trace::event(trace::EventWait, trace::End, id);
+    if (LIKELY(OK == result))
+	return Success;
+    return xlatErrno(err);
+}
+
 #ifndef NDEBUG
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 extern "C" {
     STATUS vwppTestSemaphores();
+    STATUS vwppTestEvents();
+    STATUS vwppTestCountingSemaphore();
 }
 
 // Regression test for semaphore support.
@@ -110,4 +353,252 @@ STATUS vwppTestSemaphores()
     }
 }
 
+namespace {
+
+    void check(bool const cond, char const* const what)
+    {
+	if (UNLIKELY(!cond))
+	    throw std::runtime_error(what);
+    }
+
+    // Waits once on an event, as a job, so the test can signal the
+    // event while the job is blocked or timing out.
+
+    class Waiter : public RestartableTask {
+	Event<TaskSignal>& ev;
+	int const tmo;
+
+	void jobEntry() { result = ev.try_wait(tmo); }
+
+     public:
+	Status result;
+
+	Waiter(Event<TaskSignal>& e, int const t) :
+	    ev(e), tmo(t), result(Failure)
+	{}
+
+	~Waiter() NOTHROW { kill(); }
+    };
+}
+
+// Regression test for the fast paths of events (the pending flag and
+// the waiter count.) It must be run by a task.
+
+STATUS vwppTestEvents()
+{
+    try {
+	Event<TaskSignal> ev;
+
+	// A signal sent while nobody waits is consumed by exactly
+	// one wait. A second signal, sent before the wait, isn't
+	// counted, as with a binary semaphore.
+
+	ev.wakeOne();
+	ev.wakeOne();
+	check(Success == ev.try_wait(0), "pending signal was lost");
+	check(Success != ev.try_wait(0), "pending signal was consumed twice");
+
+	// wakeAll() only releases the tasks that are waiting, so
+	// with none it does nothing.
+
+	ev.wakeAll();
+	check(Success != ev.try_wait(0), "wakeAll() left a signal pending");
+
+	// Selecting an event moves a pending signal into the
+	// semaphore, so the Selector reports it, and deselecting it
+	// moves a signal back.
+
+	{
+	    Selector sel;
+
+	    ev.wakeOne();
+
+	    size_t const idx = sel.add(ev);
+
+	    check(static_cast<int>(idx) == sel.waitOne(0),
+		  "selector missed a pending signal");
+	    check(Success == ev.try_wait(0), "selected signal was lost");
+	    check(Success != ev.try_wait(0), "selected signal was doubled");
+
+	    ev.wakeOne();
+	    sel.remove(idx);
+	}
+	check(Success == ev.try_wait(0), "deselected signal was lost");
+	check(Success != ev.try_wait(0), "deselected signal was doubled");
+
+	// wakeAll() on a selected event gives the semaphore too, so
+	// the Selector sees it. That signal latches like one from
+	// wakeOne(): a wait takes it, and if none does, it's pending
+	// once the event is deselected.
+
+	{
+	    Selector sel;
+	    size_t const idx = sel.add(ev);
+
+	    ev.wakeAll();
+	    check(static_cast<int>(idx) == sel.waitOne(0),
+		  "selector missed wakeAll()");
+	    check(Success == ev.try_wait(0), "wakeAll() didn't latch");
+	    check(Success != ev.try_wait(0), "wakeAll() latched twice");
+
+	    ev.wakeAll();
+	    sel.remove(idx);
+	}
+	check(Success == ev.try_wait(0),
+	      "wakeAll() on a selected event was lost when deselected");
+	check(Success != ev.try_wait(0),
+	      "wakeAll() on a selected event was doubled when deselected");
+
+	// Signal the event around the time a waiter times out. The
+	// waiter runs at a lower priority so, when both delays end on
+	// the same tick, the signal is sent after the waiter's
+	// semTake() timed out but before it left. The signal must
+	// end up either with the waiter or pending, never both or
+	// neither. On alternate rounds, the event is signalled again
+	// before checking; the two signals have to merge into one.
+
+	int const tmo = 20;
+	int const ticks = ms_to_tick(tmo);
+	int pri;
+	Waiter waiter(ev, tmo);
+
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	waiter.spawn("tTestEvent", std::min(pri + 10, 255), 8192);
+	for (int ii = 0; ii < 300; ++ii) {
+	    waiter.run();
+	    ::taskDelay(std::max(ticks - 1 + ii % 3, 0));
+	    ev.wakeOne();
+	    check(waiter.wait(1000), "waiter didn't return");
+
+	    bool const woke = Success == waiter.result;
+
+	    if (ii % 2) {
+		ev.wakeOne();
+		check(Success == ev.try_wait(0), "second signal was lost");
+		check(Success != ev.try_wait(0),
+		      "signal raced with a timeout was kept twice");
+	    } else {
+		bool const pending = Success == ev.try_wait(0);
+
+		check(woke != pending, woke ? "signal raced with a timeout "
+		      "was doubled" : "signal raced with a timeout was lost");
+	    }
+	}
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestEvents() : " << e.what() << std::endl;
+	return ERROR;
+    }
+}
+
+
+namespace {
+
+    // Repeatedly takes one to three units of a semaphore, holds them
+    // for up to a tick and gives them back. Every fourth request
+    // only waits a millisecond, so some of them time out. The
+    // number of units held by all the contenders is tracked to make
+    // sure it never exceeds the semaphore's capacity.
+
+    class Contender : public RestartableTask {
+	CountingSemaphore& sem;
+	Atomic<uint32_t>& inUse;
+	Atomic<uint32_t>& peak;
+	uint32_t const seed;
+
+	void jobEntry()
+	{
+	    for (uint32_t ii = 0; ii < Rounds; ++ii) {
+		uint32_t const n = 1 + (seed + ii) % 3;
+		Status const st = sem.try_acquire(n, ii % 4 ? -1 : 1);
+
+		if (Success != st) {
+		    if (Timeout != st)
+			++errors;
+		    continue;
+		}
+
+		uint32_t const used = inUse.fetch_add(n, AcqRel) + n;
+		uint32_t p = peak.load(Relaxed);
+
+		while (used > p && !peak.compare_exchange(p, used, Relaxed))
+		    ;
+		::taskDelay(ii % 2);
+		inUse.fetch_sub(n, AcqRel);
+		sem.release(n);
+		++acquired;
+	    }
+	}
+
+     public:
+	enum { Rounds = 200 };
+
+	uint32_t acquired;
+	uint32_t errors;
+
+	Contender(CountingSemaphore& s, Atomic<uint32_t>& u,
+		  Atomic<uint32_t>& p, uint32_t const sd) :
+	    sem(s), inUse(u), peak(p), seed(sd), acquired(0), errors(0)
+	{}
+
+	~Contender() NOTHROW { kill(); }
+    };
+}
+
+// Regression test for CountingSemaphore. Several tasks compete for
+// the units; they may never hold more than there are and, when
+// they're done, all the units must be available again. It must be
+// run by a task.
+
+STATUS vwppTestCountingSemaphore()
+{
+    try {
+	enum { Capacity = 4, Tasks = 6 };
+
+	CountingSemaphore sem(Capacity);
+	Atomic<uint32_t> inUse(0);
+	Atomic<uint32_t> peak(0);
+
+	check(Timeout == sem.try_acquire(Capacity + 1, 10),
+	      "took more units than exist");
+	check(Capacity == sem.available(), "a timed out request took units");
+
+	Contender c0(sem, inUse, peak, 0), c1(sem, inUse, peak, 1),
+	    c2(sem, inUse, peak, 2), c3(sem, inUse, peak, 3),
+	    c4(sem, inUse, peak, 4), c5(sem, inUse, peak, 5);
+	Contender* const task[Tasks] = { &c0, &c1, &c2, &c3, &c4, &c5 };
+	int pri;
+
+	check(OK == ::taskPriorityGet(::taskIdSelf(), &pri),
+	      "couldn't get the task's priority");
+	for (size_t ii = 0; ii < Tasks; ++ii) {
+	    int const offset = 1 + ii % 3;
+
+	    task[ii]->spawn("tTestCount", std::min(pri + offset, 255), 8192);
+	    task[ii]->run();
+	}
+
+	uint32_t acquired = 0;
+
+	for (size_t ii = 0; ii < Tasks; ++ii) {
+	    check(task[ii]->wait(60000), "a contender didn't finish");
+	    check(!task[ii]->errors, "acquiring units failed");
+	    acquired += task[ii]->acquired;
+	}
+	check(acquired > 0, "no contender got any units");
+	check(peak.load(Relaxed) <= Capacity, "more units were held than "
+	      "exist");
+	check(0 == inUse.load(Relaxed) && Capacity == sem.available(),
+	      "units were lost");
+	return OK;
+    }
+    catch (std::exception& e) {
+	std::cerr << "vwppTestCountingSemaphore() : " << e.what() <<
+	    std::endl;
+	return ERROR;
+    }
+}
+
 #endif
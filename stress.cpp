@@ -0,0 +1,416 @@
+#include <vxWorks.h>
+#include <taskLib.h>
+#include <wdLib.h>
+#include <sysLib.h>
+#include <stdio.h>
+#include <stdexcept>
+#include "./vwpp.h"
+#include "./vwpp_time.h"
+
+// This module holds a stress harness used to qualify a release on
+// the target. vwppStress() runs a configurable mix of load tasks
+// while a high priority probe task measures how long it takes to
+// respond to a (watchdog) interrupt. It then checks that Mutex and
+// CondVar::wait() don't suffer from priority inversion. The results
+// are printed on the console.
+//
+// It's built as its own module, vwppStress.out, so the load tasks
+// and their kernel objects only exist on targets that load it. It
+// also runs on a Linux host (see host/vxhost.cpp), where
+// "vwpp-host vwppStress 10 2 2 2 10" replaces the shell command.
+//
+// The task priorities, from highest to lowest, are:
+//
+//    50  probe task
+//    60  inversion tests: high priority task
+//    70  inversion tests: medium priority hog
+//    80  inversion tests: low priority task
+//   100  task receiving the interrupt-rate events
+//   110  queue flooders (sender and receiver)
+//   120  mutex lockers
+//   200  CPU hogs
+
+using namespace vwpp::v3_0;
+
+extern "C" {
+    STATUS vwppStress(int, int, int, int, int);
+}
+
+namespace {
+
+    enum { MaxLoad = 8, Buckets = 10000 };
+
+    bool volatile running;
+    uint32_t perUs;
+
+    // Spins for 'us' microseconds without blocking.
+
+    void spin(uint32_t const us)
+    {
+	uint32_t const start = read_timebase();
+
+	while ((read_timebase() - start) / perUs < us)
+	    ;
+    }
+
+    // The probe's response times, in microseconds. The last bucket
+    // collects everything that took longer than 'Buckets' - 1.
+
+    uint32_t histogram[Buckets];
+    uint32_t samples;
+    uint32_t worst;
+    uint64_t total;
+
+    void clearHistogram()
+    {
+	for (size_t ii = 0; ii < Buckets; ++ii)
+	    histogram[ii] = 0;
+	samples = worst = 0;
+	total = 0;
+    }
+
+    void recordLatency(uint32_t const us)
+    {
+	++histogram[us < Buckets ? us : Buckets - 1];
+	++samples;
+	total += us;
+	if (us > worst)
+	    worst = us;
+    }
+
+    // Returns the latency which 'ppm' parts per million of the
+    // samples didn't exceed.
+
+    uint32_t percentile(uint32_t const ppm)
+    {
+	uint64_t const limit = (static_cast<uint64_t>(samples) * ppm +
+				999999) / 1000000;
+	uint64_t count = 0;
+
+	for (size_t ii = 0; ii < Buckets; ++ii)
+	    if ((count += histogram[ii]) >= limit)
+		return ii;
+	return Buckets - 1;
+    }
+
+    // The watchdog routine runs at interrupt level on every clock
+    // tick. It time-stamps the stimulus for the probe and sends a
+    // burst of events to the load. The probe's event is a binary
+    // semaphore, so ticks the probe falls behind on merge into one
+    // signal. The ticks are therefore numbered, and the time stamps
+    // of the last 'Stamps' are kept; the probe measures from the
+    // oldest tick it hasn't handled and counts the ones it missed.
+
+    enum { Stamps = 16 };
+
+    WDOG_ID wd;
+    uint32_t volatile tickCount;
+    uint32_t volatile stimulus[Stamps];
+    int burst;
+    Event<IntSignal> probeEv;
+    Event<IntSignal> loadEv;
+    uint32_t signals;
+
+    void tick(int)
+    {
+	if (!running)
+	    return;
+
+	uint32_t const seq = tickCount + 1;
+
+	stimulus[seq % Stamps] = read_timebase();
+	tickCount = seq;
+	probeEv.wakeOne();
+	for (int ii = 0; ii < burst; ++ii)
+	    loadEv.wakeOne();
+	signals += burst;
+	::wdStart(wd, 1, reinterpret_cast<FUNCPTR>(tick), 0);
+    }
+
+    // The last tick the probe handled and the number of ticks it
+    // missed because it was still handling an earlier one.
+
+    uint32_t handled;
+    uint32_t missed;
+
+    class Probe : public Task {
+	void taskEntry()
+	{
+	    while (running) {
+		IntLock lock;
+
+		if (!probeEv.wait(lock, 1000))
+		    continue;
+
+		uint32_t const now = read_timebase();
+		uint32_t const last = tickCount;
+
+		if (last == handled)
+		    continue;
+
+		// If the oldest unhandled tick's time stamp was
+		// overwritten, the oldest one left is used.
+
+		uint32_t const late = last - handled - 1;
+		uint32_t const oldest =
+		    late < Stamps ? handled + 1 : last - (Stamps - 1);
+
+		missed += late;
+		handled = last;
+		recordLatency(counts_to_us(now - stimulus[oldest % Stamps]));
+	    }
+	}
+    };
+
+    class EventLoad : public Task {
+	void taskEntry()
+	{
+	    while (running) {
+		IntLock lock;
+
+		loadEv.wait(lock, 100);
+	    }
+	}
+    };
+
+    class Hog : public Task {
+	void taskEntry()
+	{
+	    while (running)
+		spin(1000);
+	}
+    };
+
+    Mutex loadMtx;
+    uint32_t lockCount;
+
+    // The lockers run at different priorities and sleep between
+    // bursts, so higher priority lockers often find the mutex held
+    // by lower priority ones.
+
+    class Locker : public Task {
+	void taskEntry()
+	{
+	    while (running) {
+		for (int ii = 0; ii < 20; ++ii) {
+		    {
+			Mutex::Lock<loadMtx> lock;
+
+			++lockCount;
+			spin(50);
+		    }
+		    spin(50);
+		}
+		::taskDelay(1);
+	    }
+	}
+    };
+
+    Queue<uint32_t, 64> floodQ;
+    uint32_t received;
+
+    class FloodSender : public Task {
+	void taskEntry()
+	{
+	    uint32_t seq = 0;
+
+	    while (running) {
+		for (int ii = 0; ii < 64; ++ii)
+		    floodQ.push_back(seq++, 100);
+		::taskDelay(1);
+	    }
+	}
+    };
+
+    class FloodReceiver : public Task {
+	void taskEntry()
+	{
+	    uint32_t tmp;
+
+	    while (running)
+		if (floodQ.pop_front(tmp, 100))
+		    ++received;
+	}
+    };
+
+    Probe probe;
+    EventLoad eventLoad;
+    Hog hogs[MaxLoad];
+    Locker lockers[MaxLoad];
+    FloodSender senders[MaxLoad];
+    FloodReceiver receivers[MaxLoad];
+
+    // Waits for a task to return from taskEntry().
+
+    void join(Task const& t)
+    {
+	while (t.isValid())
+	    ::taskDelay(1);
+    }
+
+    // The priority inversion tests. The low priority task holds
+    // the mutex for 'HoldUs' while the medium priority task hogs
+    // the CPU for five times as long. With priority inheritance,
+    // the high priority task waits about 'HoldUs'; without it, it
+    // waits for the hog.
+
+    enum { HoldUs = 2000 };
+
+    Mutex invMtx;
+    CondVar<invMtx> invCv;
+    Event<TaskSignal> heldEv;
+    Event<TaskSignal> hogEv;
+    bool useCondVar;
+    uint32_t signalled;
+    uint32_t waited;
+
+    class Medium : public Task {
+	void taskEntry()
+	{
+	    if (hogEv.wait(1000))
+		spin(HoldUs * 5);
+	}
+    };
+
+    Medium medium;
+
+    class Low : public Task {
+	void taskEntry()
+	{
+	    Mutex::Lock<invMtx> lock;
+
+	    if (useCondVar) {
+		signalled = read_timebase();
+		invCv.signal(lock);
+	    } else
+		heldEv.wakeOne();
+	    hogEv.wakeOne();
+	    spin(HoldUs);
+	}
+    };
+
+    Low low;
+
+    class High : public Task {
+	void taskEntry()
+	{
+	    medium.run("tStressMed", 70, 8192);
+	    if (useCondVar) {
+		Mutex::Lock<invMtx> lock;
+
+		low.run("tStressLow", 80, 8192);
+
+		// Returning from wait() requires the mutex, which the
+		// low priority task is holding.
+
+		if (invCv.wait(lock, 1000))
+		    waited = counts_to_us(read_timebase() - signalled);
+	    } else {
+		low.run("tStressLow", 80, 8192);
+		if (heldEv.wait(1000)) {
+		    uint32_t const start = read_timebase();
+		    Mutex::Lock<invMtx> lock;
+
+		    waited = counts_to_us(read_timebase() - start);
+		}
+	    }
+	}
+    };
+
+    High high;
+
+    bool inversionTest(bool const cv)
+    {
+	useCondVar = cv;
+	waited = ~0u;
+	high.run("tStressHigh", 60, 8192);
+	join(high);
+	join(low);
+	join(medium);
+	return waited < HoldUs * 2;
+    }
+
+    void startLoad(int const nHogs, int const nLockers, int const nFlood)
+    {
+	probe.run("tStressProbe", 50, 8192);
+	eventLoad.run("tStressEvent", 100, 8192);
+	for (int ii = 0; ii < nFlood; ++ii) {
+	    senders[ii].run("tStressSend", 110, 8192);
+	    receivers[ii].run("tStressRecv", 110, 8192);
+	}
+	for (int ii = 0; ii < nLockers; ++ii)
+	    lockers[ii].run("tStressLock", 120 + ii, 8192);
+	for (int ii = 0; ii < nHogs; ++ii)
+	    hogs[ii].run("tStressHog", 200, 8192);
+    }
+
+    void stopLoad()
+    {
+	running = false;
+	join(probe);
+	join(eventLoad);
+	for (size_t ii = 0; ii < MaxLoad; ++ii) {
+	    join(senders[ii]);
+	    join(receivers[ii]);
+	    join(lockers[ii]);
+	    join(hogs[ii]);
+	}
+    }
+}
+
+// Runs the load for 'seconds' with the given number of CPU hogs,
+// mutex lockers and queue flooder pairs. 'rate' events are sent to
+// a waiting task on every clock tick. Each count is limited to
+// MaxLoad. Returns ERROR if a test failed.
+
+STATUS vwppStress(int const seconds, int const nHogs, int const nLockers,
+		  int const nFlood, int const rate)
+{
+    try {
+	if (running)
+	    throw std::logic_error("stress test is already running");
+	if (nHogs < 0 || nHogs > MaxLoad || nLockers < 0 ||
+	    nLockers > MaxLoad || nFlood < 0 || nFlood > MaxLoad)
+	    throw std::out_of_range("too many load tasks");
+
+	perUs = timebase_per_us();
+	clearHistogram();
+	lockCount = received = signals = 0;
+	tickCount = handled = missed = 0;
+	burst = rate > 0 ? rate : 0;
+
+	if (!wd && !(wd = ::wdCreate()))
+	    throw std::bad_alloc();
+
+	running = true;
+	startLoad(nHogs, nLockers, nFlood);
+	::wdStart(wd, 1, reinterpret_cast<FUNCPTR>(tick), 0);
+	::taskDelay((seconds > 0 ? seconds : 10) * ::sysClkRateGet());
+	stopLoad();
+	::wdCancel(wd);
+
+	printf("probe response: %u samples, mean %u us, p99 %u us, "
+	       "p99.99 %u us, max %u us\n", samples,
+	       samples ? static_cast<unsigned>(total / samples) : 0,
+	       percentile(990000), percentile(999900), worst);
+	printf("probe overruns: %u ticks missed\n", missed);
+	printf("load: %u mutex locks, %u queue messages, %u events\n",
+	       lockCount, received, signals);
+
+	bool const mtxOk = inversionTest(false);
+
+	printf("priority inversion, Mutex: %s (waited %u us, held %u us)\n",
+	       mtxOk ? "PASS" : "FAIL", waited, HoldUs);
+
+	bool const cvOk = inversionTest(true);
+
+	printf("priority inversion, CondVar::wait: %s (waited %u us, "
+	       "held %u us)\n", cvOk ? "PASS" : "FAIL", waited, HoldUs);
+	return mtxOk && cvOk ? OK : ERROR;
+    }
+    catch (std::exception& e) {
+	running = false;
+	printf("vwppStress() : %s\n", e.what());
+	return ERROR;
+    }
+}
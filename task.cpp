@@ -4,6 +4,7 @@
 #include <sysLib.h>
 #include <stdexcept>
 #include "./vwpp.h"
+#include "./vwpp_monitor.h"
 
 using namespace vwpp::v3_0;
 
@@ -14,12 +15,17 @@ using namespace vwpp::v3_0;
 
 void Task::initTask(Task* tt)
 {
+    TaskMonitor::attach(::taskIdSelf());
+    trace::event(trace::TaskRun, trace::Begin, tt);
+
     try {
 	tt->taskEntry();
     }
     catch (...) {
 	::taskSuspend(0);
     }
+    trace::event(trace::TaskRun, trace::End, tt);
+    TaskMonitor::detach(::taskIdSelf());
     tt->id = ERROR;
 }
 
@@ -29,8 +35,20 @@ Task::Task() : id(ERROR)
 
 Task::~Task() NOTHROW_IMPL
 {
-    if (ERROR != id)
+    kill();
+}
+
+// Deletes the VxWorks task. Derived classes whose task uses their
+// data members need to call this in their destructor, before the
+// members are destroyed.
+
+void Task::kill() NOTHROW_IMPL
+{
+    if (ERROR != id) {
+	TaskMonitor::detach(id);
 	::taskDelete(id);
+	id = ERROR;
+    }
 }
 
 // Delays the current task. The delay is given in milliseconds. If,
@@ -43,15 +61,34 @@ void Task::delay(int const dly) const
 }
 
 void Task::run(char const* const name, unsigned char const pri, int const ss)
+{
+    switch (try_run(name, pri, ss)) {
+     case Success:
+	break;
+
+     case Unavailable:
+	throw std::logic_error("task is already started");
+
+     default:
+	throw std::runtime_error("couldn't start new task");
+    }
+}
+
+// Non-throwing version of run(). Returns Unavailable if the task is
+// already running or Failure if VxWorks couldn't create it.
+
+Status Task::try_run(char const* const name, unsigned char const pri,
+		     int const ss) NOTHROW_IMPL
 {
     if (ERROR == id) {
 	if (ERROR == (id = ::taskSpawn(const_cast<char*>(name), pri,VX_FP_TASK,
 				       ss, reinterpret_cast<FUNCPTR>(initTask),
-				       reinterpret_cast<int>(this), 0, 0, 0, 0,
+				       reinterpret_cast<long>(this), 0, 0, 0, 0,
 				       0, 0, 0, 0, 0)))
-	    throw std::runtime_error("couldn't start new task");
+	    return Failure;
+	return Success;
     } else
-	throw std::logic_error("task is already started");
+	return Unavailable;
 }
 
 int Task::priority() const
@@ -93,6 +130,88 @@ void Task::resume() const
     ::taskResume(id);
 }
 
+RestartableTask::~RestartableTask() NOTHROW_IMPL
+{
+    kill();
+}
+
+// This is the body of the VxWorks task. It never returns; the task
+// is deleted by the destructor.
+
+void RestartableTask::taskEntry()
+{
+    while (true) {
+	start.wait();
+
+	try {
+	    jobEntry();
+	}
+	catch (...) {
+	}
+
+	{
+	    SchedLock lock;
+
+	    state.store(Idle, Release);
+	    finished.wakeAll();
+	}
+    }
+}
+
+void RestartableTask::spawn(char const* const name, unsigned char const pri,
+			    int const ss)
+{
+    switch (try_spawn(name, pri, ss)) {
+     case Success:
+	break;
+
+     case Unavailable:
+	throw std::logic_error("task is already started");
+
+     default:
+	throw std::runtime_error("couldn't start new task");
+    }
+}
+
+Status RestartableTask::try_spawn(char const* const name,
+				  unsigned char const pri,
+				  int const ss) NOTHROW_IMPL
+{
+    Status const st = Task::try_run(name, pri, ss);
+
+    if (LIKELY(Success == st))
+	state.store(Idle, Release);
+    return st;
+}
+
+void RestartableTask::run()
+{
+    if (UNLIKELY(Success != try_run()))
+	throw std::logic_error("task isn't spawned or is still busy");
+}
+
+Status RestartableTask::try_run() NOTHROW_IMPL
+{
+    State expected = Idle;
+
+    if (LIKELY(state.compare_exchange(expected, Busy, AcqRel))) {
+	start.wakeOne();
+	return Success;
+    }
+    return Unavailable;
+}
+
+// The scheduler is locked while checking the state so the task
+// can't finish the job, and flush the event, before this task
+// blocks on it.
+
+bool RestartableTask::wait(int const tmo)
+{
+    SchedLock lock;
+
+    return Busy != state.load(Acquire) || finished.wait(tmo);
+}
+
 #ifndef NDEBUG
 
 STATUS vwppTestTasks()
@@ -0,0 +1,181 @@
+#include <vxWorks.h>
+#include <stdio.h>
+#include <algorithm>
+#include <stdexcept>
+#include "./vwpp_time.h"
+
+using namespace vwpp::v3_0;
+
+namespace {
+
+    // The registered histograms, newest first, and the mutex that
+    // guards the list. Histograms are often defined at namespace
+    // scope in other modules, so the registry is created by the
+    // first one constructed rather than by this module's static
+    // initializers. Since it is constructed inside that
+    // histogram's constructor, it is also destroyed after the last
+    // histogram.
+
+    struct Registry {
+	Mutex mtx;
+	Histogram* head;
+
+	Registry() : head(0) {}
+    };
+
+    typedef Mutex::PMLock<Registry, &Registry::mtx> RegLock;
+    typedef Mutex::PMTryLock<Registry, &Registry::mtx> RegTryLock;
+
+    Registry& registry()
+    {
+	static Registry reg;
+
+	return reg;
+    }
+
+    // Converts 'c' counts to units of 1/'per' seconds. The quotient
+    // and remainder are scaled separately so the product can't
+    // overflow.
+
+    inline uint64_t scale(uint64_t const c, uint64_t const per)
+    {
+	uint64_t const hz = timebase_hz();
+
+	return (c / hz) * per + (c % hz) * per / hz;
+    }
+
+    // The largest duration, in counts, that falls in bucket 'n'.
+
+    inline uint32_t upperBound(size_t const n)
+    {
+	return n < 32 ? (1u << n) - 1 : ~0u;
+    }
+
+    // Formats a duration in microseconds, with three decimals, so
+    // printf() doesn't need 64-bit support. 'buf' needs room for
+    // 15 characters.
+
+    char const* fmtUs(char* const buf, uint64_t const ns)
+    {
+	sprintf(buf, "%u.%03u", static_cast<unsigned>(ns / 1000),
+		static_cast<unsigned>(ns % 1000));
+	return buf;
+    }
+}
+
+uint64_t vwpp::v3_0::counts_to_ns(uint64_t const c)
+{
+    return scale(c, 1000000000ull);
+}
+
+uint64_t vwpp::v3_0::counts_to_us(uint64_t const c)
+{
+    return scale(c, 1000000ull);
+}
+
+Histogram::Histogram(char const* const name) :
+    label(name ? name : "(unnamed)"), next(0), total(0), worst(0)
+{
+    for (size_t ii = 0; ii < Buckets; ++ii)
+	bucket[ii].store(0, Relaxed);
+
+    Registry& reg = registry();
+    RegLock lock(&reg);
+
+    next = reg.head;
+    reg.head = this;
+}
+
+// The constructor created the registry, so it still exists. Waiting
+// forever on a valid mutex can't fail but, if it somehow does, the
+// histogram is left registered rather than throwing from here.
+
+Histogram::~Histogram() NOTHROW_IMPL
+{
+    Registry& reg = registry();
+    RegTryLock lock(&reg);
+
+    if (LIKELY(lock.owns_lock()))
+	for (Histogram** ptr = &reg.head; *ptr; ptr = &(*ptr)->next)
+	    if (*ptr == this) {
+		*ptr = next;
+		break;
+	    }
+}
+
+// Samples may be recorded while this runs, so the total is taken
+// from the buckets that are scanned rather than from 'total'.
+
+uint64_t Histogram::percentileNs(uint32_t const ppm) const
+{
+    uint32_t counts[Buckets];
+    uint64_t sum = 0;
+
+    for (size_t ii = 0; ii < Buckets; ++ii)
+	sum += counts[ii] = bucket[ii].load(Relaxed);
+    if (!sum)
+	return 0;
+
+    uint64_t const target =
+	(sum * std::min(ppm, 1000000u) + 999999) / 1000000;
+    uint32_t const max = worst.load(Relaxed);
+
+    sum = 0;
+    for (size_t ii = 0; ii < Buckets; ++ii)
+	if ((sum += counts[ii]) >= target)
+	    return counts_to_ns(std::min(upperBound(ii), max));
+    return counts_to_ns(max);
+}
+
+void Histogram::reset() NOTHROW_IMPL
+{
+    for (size_t ii = 0; ii < Buckets; ++ii)
+	bucket[ii].store(0, Relaxed);
+    total.store(0, Relaxed);
+    worst.store(0, Relaxed);
+}
+
+void Histogram::show() const
+{
+    char p50[16], p99[16], p999[16], max[16];
+
+    printf("%s: %u samples, p50 %s, p99 %s, p99.9 %s, max %s us\n",
+	   label, static_cast<unsigned>(samples()),
+	   fmtUs(p50, percentileNs(500000)),
+	   fmtUs(p99, percentileNs(990000)),
+	   fmtUs(p999, percentileNs(999000)),
+	   fmtUs(max, maxNs()));
+
+    for (size_t ii = 0; ii < Buckets; ++ii) {
+	uint32_t const count = bucket[ii].load(Relaxed);
+
+	if (count) {
+	    char bound[16];
+
+	    printf("    <= %14s us: %10u\n",
+		   fmtUs(bound, counts_to_ns(upperBound(ii))),
+		   static_cast<unsigned>(count));
+	}
+    }
+}
+
+void Histogram::showAll()
+{
+    Registry& reg = registry();
+    RegLock lock(&reg);
+
+    for (Histogram const* ptr = reg.head; ptr; ptr = ptr->next)
+	ptr->show();
+}
+
+STATUS vwppHistShow()
+{
+    try {
+	Histogram::showAll();
+	return OK;
+    }
+    catch (std::exception& e) {
+	printf("vwppHistShow() : %s\n", e.what());
+	return ERROR;
+    }
+}
@@ -0,0 +1,223 @@
+#include <vxWorks.h>
+#include <taskLib.h>
+#include <intLib.h>
+#include <ioLib.h>
+#include <fioLib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include "./vwpp_trace.h"
+#include "./vwpp_time.h"
+
+using namespace vwpp::v3_0;
+
+bool volatile vwpp::v3_0::trace::enabled;
+
+namespace {
+
+    struct Entry {
+	uint32_t time;
+	uint8_t kind;
+	uint8_t phase;
+	void const* obj;
+    };
+
+    // Only the owning task writes to its buffer, so 'next' needs no
+    // protection. The owner field is claimed with a compare-and-
+    // swap the first time a task records an event.
+
+    struct Buffer {
+	Atomic<int> owner;
+	char name[16];
+	uint32_t next;
+	Entry ev[Trace::BufferSize];
+    };
+
+    Buffer buffers[Trace::MaxTasks];
+    Buffer isrBuffer;
+    Atomic<uint32_t> lost;
+    uint32_t startTime;
+
+    char const* const names[] = {
+	"semTake", "semGive", "msgQSend", "msgQReceive", "eventWait",
+	"eventWake", "task"
+    };
+
+    char const* const categories[] = {
+	"sem", "sem", "queue", "queue", "event", "event", "task"
+    };
+
+    inline size_t hash(int const id)
+    {
+	return (static_cast<unsigned>(id) >> 4) % Trace::MaxTasks;
+    }
+
+    // Finds the buffer of a task, claiming a free one if the task
+    // doesn't have one yet.
+
+    Buffer* lookup(int const id)
+    {
+	size_t idx = hash(id);
+
+	for (size_t ii = 0; ii < Trace::MaxTasks; ++ii) {
+	    Buffer& b = buffers[idx];
+	    int owner = b.owner.load(Acquire);
+
+	    if (owner == id)
+		return &b;
+	    if (!owner) {
+		if (b.owner.compare_exchange(owner, id, AcqRel)) {
+		    char const* const name = ::taskName(id);
+
+		    strncpy(b.name, name ? name : "?", sizeof(b.name) - 1);
+		    b.name[sizeof(b.name) - 1] = '\0';
+		    return &b;
+		}
+		if (owner == id)
+		    return &b;
+	    }
+	    idx = (idx + 1) % Trace::MaxTasks;
+	}
+	return 0;
+    }
+
+    inline void append(Buffer& b, trace::Kind const k, trace::Phase const p,
+		       void const* const obj)
+    {
+	Entry& e = b.ev[b.next % Trace::BufferSize];
+
+	e.time = read_timebase();
+	e.kind = k;
+	e.phase = p;
+	e.obj = obj;
+	++b.next;
+    }
+
+    void clear(Buffer& b)
+    {
+	b.owner.store(0, Relaxed);
+	b.name[0] = '\0';
+	b.next = 0;
+    }
+
+    void exportBuffer(int const fd, Buffer const& b, int const tid,
+		      bool& first)
+    {
+	::fdprintf(fd, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		   "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		   first ? "" : ",\n", tid, b.name);
+	first = false;
+
+	uint32_t const n = std::min(b.next, static_cast<uint32_t>
+				    (Trace::BufferSize));
+
+	for (uint32_t ii = b.next - n; ii != b.next; ++ii) {
+	    Entry const& e = b.ev[ii % Trace::BufferSize];
+	    uint32_t const ts = counts_to_us(e.time - startTime);
+	    char const* const ph = trace::Begin == e.phase ? "B" :
+		(trace::End == e.phase ? "E" : "i\",\"s\":\"t");
+
+	    ::fdprintf(fd, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\","
+		       "\"ts\":%u,\"pid\":1,\"tid\":%d,"
+		       "\"args\":{\"obj\":\"%p\"}}", names[e.kind],
+		       categories[e.kind], ph, ts, tid, e.obj);
+	}
+    }
+}
+
+// Called by the hooks when tracing is enabled. This mustn't change
+// errno since the callers check it after recording.
+
+void trace::record(Kind const k, Phase const p,
+		   void const* const obj) NOTHROW_IMPL
+{
+    int const err = errno;
+
+    if (::intContext()) {
+	IntLock lock;
+
+	append(isrBuffer, k, p, obj);
+    } else {
+	Buffer* const b = lookup(::taskIdSelf());
+
+	if (LIKELY(b != 0))
+	    append(*b, k, p, obj);
+	else
+	    lost.fetch_add(1, Relaxed);
+    }
+    errno = err;
+}
+
+// Empties the buffers and starts recording.
+
+void Trace::start() NOTHROW_IMPL
+{
+    trace::enabled = false;
+    for (size_t ii = 0; ii < MaxTasks; ++ii)
+	clear(buffers[ii]);
+    clear(isrBuffer);
+    strcpy(isrBuffer.name, "interrupts");
+    lost.store(0, Relaxed);
+    startTime = read_timebase();
+    trace::enabled = true;
+}
+
+void Trace::stop() NOTHROW_IMPL
+{
+    trace::enabled = false;
+}
+
+void Trace::exportChrome(int const fd)
+{
+    bool first = true;
+
+    ::fdprintf(fd, "{\"traceEvents\":[\n");
+    if (isrBuffer.next)
+	exportBuffer(fd, isrBuffer, 0, first);
+    for (size_t ii = 0; ii < MaxTasks; ++ii) {
+	Buffer const& b = buffers[ii];
+	int const owner = b.owner.load(Acquire);
+
+	if (owner)
+	    exportBuffer(fd, b, owner, first);
+    }
+    ::fdprintf(fd, "\n]}\n");
+}
+
+uint32_t Trace::dropped() NOTHROW_IMPL
+{
+    return lost.load(Relaxed);
+}
+
+STATUS vwppTraceStart()
+{
+    Trace::start();
+    return OK;
+}
+
+STATUS vwppTraceStop()
+{
+    Trace::stop();
+    return OK;
+}
+
+STATUS vwppTraceExport(char const* const path)
+{
+    int const fd = ::open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+    if (ERROR == fd) {
+	printf("vwppTraceExport() : couldn't open '%s'\n", path);
+	return ERROR;
+    }
+    try {
+	Trace::exportChrome(fd);
+	::close(fd);
+	return OK;
+    }
+    catch (std::exception& e) {
+	::close(fd);
+	printf("vwppTraceExport() : %s\n", e.what());
+	return ERROR;
+    }
+}
@@ -1,5 +1,8 @@
 #include <vxWorks.h>
 #include <sysLib.h>
+#include <taskLib.h>
+#include <tickLib.h>
+#include <time.h>
 #include <algorithm>
 #include "./vwpp.h"
 
@@ -11,6 +14,116 @@ int vwpp::v3_0::ms_to_tick(int const v)
 	return (std::max(v, 0) * ::sysClkRateGet() + 999) / 1000;
 }
 
+vwpp::v3_0::Deadline::Deadline(int const t) :
+    start(static_cast<uint32_t>(::tickGet())), tmo(t)
+{
+}
+
+int vwpp::v3_0::Deadline::remaining() const NOTHROW_IMPL
+{
+    if (tmo < 0)
+	return -1;
+
+    uint64_t const elapsed =
+	static_cast<uint64_t>(static_cast<uint32_t>(::tickGet()) - start) *
+	1000 / ::sysClkRateGet();
+
+    return elapsed < static_cast<uint64_t>(tmo) ?
+	static_cast<int>(tmo - elapsed) : 0;
+}
+
+#if !(defined(PPC603) || defined(PPC604) || defined(PPC750) || \
+      defined(PPC7400))
+uint32_t vwpp::v3_0::read_timebase() NOTHROW_IMPL
+{
+    return static_cast<uint32_t>(read_timebase64());
+}
+
+uint64_t vwpp::v3_0::read_timebase64() NOTHROW_IMPL
+{
+    struct timespec ts;
+
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t vwpp::v3_0::timebase_hz()
+{
+    return 1000000000u;
+}
+#else
+namespace {
+    uint32_t tbHz;
+}
+
+// Counts the time base across a few clock ticks. Both ends of the
+// measurement busy-wait for the tick counter to change so the result
+// doesn't depend on how quickly the scheduler wakes us up.
+
+uint32_t vwpp::v3_0::timebase_hz()
+{
+    if (UNLIKELY(!tbHz)) {
+	int const rate = ::sysClkRateGet();
+	unsigned long const ticks = std::max(rate / 20, 2);
+	unsigned long const t0 = ::tickGet();
+
+	while (::tickGet() == t0)
+	    ;
+
+	uint64_t const tb0 = read_timebase64();
+
+	::taskDelay(ticks - 1);
+	while (::tickGet() - t0 <= ticks)
+	    ;
+
+	uint64_t const counts = read_timebase64() - tb0;
+
+	tbHz = std::max(static_cast<uint32_t>(counts * rate / ticks), 1u);
+    }
+    return tbHz;
+}
+#endif
+
+uint32_t vwpp::v3_0::timebase_per_us()
+{
+    return std::max(timebase_hz() / 1000000u, 1u);
+}
+
+vwpp::v3_0::VME::Poller::Poller(int const t) :
+    start(read_timebase()), perUs(timebase_per_us()),
+    limitUs(t < 0 ? ~0u : static_cast<uint32_t>(std::min(t, 4000000)) * 1000u),
+    tmo(t), pause(1), tickStart(0), sleeping(false)
+{
+}
+
+bool vwpp::v3_0::VME::Poller::next()
+{
+    if (!sleeping) {
+	uint32_t const elapsed = (read_timebase() - start) / perUs;
+
+	if (elapsed >= limitUs)
+	    return false;
+	if (elapsed < SpinUs)
+	    return true;
+	if (elapsed < BackoffUs) {
+	    uint32_t const until = elapsed + std::min(pause, limitUs - elapsed);
+
+	    while ((read_timebase() - start) / perUs < until)
+		;
+	    pause = std::min(pause * 2, static_cast<uint32_t>(MaxPauseUs));
+	    return true;
+	}
+	sleeping = true;
+	tickStart = ::tickGet();
+    }
+
+    if (tmo >= 0 &&
+	::tickGet() - tickStart >= static_cast<uint32_t>(ms_to_tick(tmo)))
+	return false;
+    ::taskDelay(1);
+    return true;
+}
+
 uint8_t* vwpp::v3_0::VME::calcBaseAddr(VME::AddressSpace const tag, uint32_t const base)
 {
     char* addr;
@@ -18,19 +18,40 @@
 #include <vwpp_types-3.0.h>
 #endif
 
-// These macros emit assembly instructions which implement "barriers"
-// used to force ordering.
+// These functions implement the "barriers" used to force ordering.
+// Each architecture uses the lightest instruction which provides the
+// ordering:
 //
-// MEMORY_SYNC prevents the processor from performing load or store
-// operations until all previous load and store operations complete.
+// load_fence() keeps earlier loads from being performed after later
+// loads or stores.
 //
-// INSTRUCTION_SYNC prevents the processor from proceeding until all
-// previous instructions have completed their execution (which
-// includes load or store operations.)
+// store_fence() keeps earlier stores from being performed after
+// later stores.
 //
-// ALL_SYNC is the most expensive sync primitive (in terms of
-// performance.) It prevents the CPU pipeline from doing loads/stores
-// and instruction fetches until all previous activity is complete.
+// io_fence() orders all accesses to device memory (e.g. VME
+// windows): earlier loads and stores are performed before later
+// ones.
+//
+// full_fence() orders all earlier loads and stores, to any kind of
+// memory, with all later ones.
+//
+// instruction_sync() prevents the processor from proceeding until
+// all previous instructions have completed their execution (which
+// includes load or store operations.) It's used before reads which
+// mustn't happen speculatively.
+//
+// optimizer_barrier() only keeps the compiler from moving memory
+// accesses across it.
+//
+// The older names are still provided: memory_sync() is io_fence()
+// and global_sync() is full_fence(). The VXPP_*_SYNC macros are only
+// defined for PowerPC.
+//
+// The PowerPC 60x and 7400 cores don't implement "lwsync", so
+// load_fence() needs a full "sync". x86-64 doesn't reorder loads
+// with loads, or stores with stores, and vwpp maps device memory
+// uncached (which x86 never reorders) so only full_fence() needs an
+// instruction. Other targets use the C++11 fences.
 
 #if defined(PPC603) || defined(PPC604) || defined(PPC750) || defined(PPC7400)
 #define	VXPP_MEMORY_SYNC	asm volatile ("eieio" ::: "memory")
@@ -39,12 +60,85 @@
 
 namespace vwpp {
     namespace v3_0 {
-	inline void memory_sync() { asm volatile ("eieio" ::: "memory"); }
+	inline void load_fence() { asm volatile ("sync" ::: "memory"); }
+	inline void store_fence() { asm volatile ("eieio" ::: "memory"); }
+	inline void io_fence() { asm volatile ("eieio" ::: "memory"); }
+	inline void full_fence() { asm volatile ("sync" ::: "memory"); }
 	inline void instruction_sync() { asm volatile ("isync" ::: "memory"); }
-	inline void global_sync() { asm volatile ("sync" ::: "memory"); }
 	inline void optimizer_barrier() { asm volatile ("" ::: "memory"); }
     };
 };
+#elif defined(__x86_64__)
+namespace vwpp {
+    namespace v3_0 {
+	inline void optimizer_barrier() { asm volatile ("" ::: "memory"); }
+	inline void load_fence() { optimizer_barrier(); }
+	inline void store_fence() { optimizer_barrier(); }
+	inline void io_fence() { optimizer_barrier(); }
+	inline void full_fence() { asm volatile ("mfence" ::: "memory"); }
+	inline void instruction_sync() { asm volatile ("lfence" ::: "memory"); }
+    };
+};
+#elif defined(__aarch64__)
+namespace vwpp {
+    namespace v3_0 {
+	inline void load_fence() { asm volatile ("dmb ishld" ::: "memory"); }
+	inline void store_fence() { asm volatile ("dmb ishst" ::: "memory"); }
+	inline void io_fence() { asm volatile ("dmb osh" ::: "memory"); }
+	inline void full_fence() { asm volatile ("dmb sy" ::: "memory"); }
+	inline void instruction_sync() { asm volatile ("isb" ::: "memory"); }
+	inline void optimizer_barrier() { asm volatile ("" ::: "memory"); }
+    };
+};
+#else
+#include <atomic>
+
+namespace vwpp {
+    namespace v3_0 {
+	inline void load_fence()
+	{
+	    std::atomic_thread_fence(std::memory_order_acquire);
+	}
+
+	inline void store_fence()
+	{
+	    std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	inline void io_fence()
+	{
+	    std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	inline void full_fence()
+	{
+	    std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	inline void instruction_sync()
+	{
+	    std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	inline void optimizer_barrier()
+	{
+	    std::atomic_signal_fence(std::memory_order_seq_cst);
+	}
+    };
+};
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+	inline void memory_sync() { io_fence(); }
+	inline void global_sync() { full_fence(); }
+    };
+};
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp_atomic.h"
+#else
+#include <vwpp_atomic-3.0.h>
 #endif
 
 // These forward-declared structures and functions are found in
@@ -116,8 +210,59 @@ namespace vwpp {
 		std::runtime_error(msg ? msg : "timeout obtaining resource") {}
 	};
 
+	// The blocking operations also have non-throwing variants
+	// (prefixed with 'try_') which return one of these values.
+	// Loops that expect timeouts as a normal outcome should use
+	// them, since unwinding an exception is expensive on our
+	// targets. They are also the only way to report errors in
+	// modules built without exception support.
+
+	enum Status {
+	    Success, Timeout, NotIsrCallable, BadHandle, Unavailable,
+	    Deleted, BadLength, Failure, OutOfRange
+	};
+
+	// Tracks how much of a timeout, given in milliseconds, is
+	// left. It's used when one timeout covers several waits.
+	// remaining() returns -1 if the timeout was -1 (forever) and
+	// 0 once it has expired.
+
+	class Deadline {
+	    uint32_t const start;
+	    int const tmo;
+
+	 public:
+	    explicit Deadline(int);
+
+	    int remaining() const NOTHROW;
+	};
+
 	class IntLock;
 
+	// Hooks for the optional trace recorder (see vwpp_trace.h.)
+	// Until Trace::start() is called, each hook only costs a load
+	// and a branch.
+
+	namespace trace {
+	    enum Kind {
+		SemAcquire, SemRelease, QueueSend, QueueReceive, EventWait,
+		EventWake, TaskRun
+	    };
+
+	    enum Phase { Begin, End, Instant };
+
+	    extern bool volatile enabled;
+
+	    void record(Kind, Phase, void const*) NOTHROW;
+
+	    inline void event(Kind const k, Phase const p,
+			      void const* const obj) NOTHROW_IMPL
+	    {
+		if (UNLIKELY(enabled))
+		    record(k, p, obj);
+	    }
+	};
+
 	// Base class for semaphore-like resources.
 
 	class SemaphoreBase : private Uncopyable, private NoHeap {
@@ -126,7 +271,13 @@ namespace vwpp {
 
 	 protected:
 	    void acquire(int);
-	    void release() NOTHROW { ::semGive(res); }
+	    Status try_acquire(int) NOTHROW;
+	    void release() NOTHROW
+	    {
+		trace::event(trace::SemRelease, trace::Instant, res);
+		::semGive(res);
+	    }
+	    void flush() NOTHROW { ::semFlush(res); }
 
 	    explicit SemaphoreBase(semaphore* const tmp) : res(tmp) {}
 
@@ -138,16 +289,27 @@ namespace vwpp {
 	    }
 	};
 
+	// The coroutine scheduler (see vwpp_coro.h) watches events
+	// and queues the way a Selector does, and tries mutexes
+	// without blocking.
+
+	namespace coro {
+	    class Watch;
+	};
+
 	// Mutexes are mutual exclusion locks. They can be locked
 	// multiple times by the same process. They also support
 	// priority inversion and, while a task owns the mutex, it
 	// cannot be deleted.
 
 	class Mutex : public SemaphoreBase {
+	    friend class coro::Watch;
 	    template <Mutex& mtx> friend class Lock;
+	    template <Mutex& mtx> friend class TryLock;
 	    template <Mutex& mtx> friend class LockWithInt;
 	    template <Mutex& mtx> friend class Unlock;
 	    template <typename T, Mutex T::*PMtx> friend class PMLock;
+	    template <typename T, Mutex T::*PMtx> friend class PMTryLock;
 	    template <typename T, Mutex T::*PMtx> friend class PMLockWithInt;
 	    template <typename T, Mutex T::*PMtx> friend class PMUnlock;
 
@@ -159,19 +321,49 @@ namespace vwpp {
 	    // associated.
 
 	    template <Mutex& mtx>
-	    class Lock : private Uncopyable, private NoHeap {
+	    class Lock :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
 	     public:
 		explicit Lock(int tmo = -1) { mtx.acquire(tmo); }
 		~Lock() NOTHROW { mtx.release(); }
 	    };
 
+	    // Mutex::TryLock<> is the non-throwing version of
+	    // Mutex::Lock<>. If the mutex can't be obtained, the
+	    // reason is saved and can be retrieved with status(). The
+	    // destructor only releases the mutex if it was obtained.
+	    // Since ownership isn't known at compile-time, a TryLock<>
+	    // can't be used where a Lock<> is required as proof of
+	    // ownership.
+
+	    template <Mutex& mtx>
+	    class TryLock :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
+		Status const result;
+
+	     public:
+		explicit TryLock(int tmo = -1) NOTHROW :
+		    result(mtx.try_acquire(tmo))
+		{}
+
+		~TryLock() NOTHROW
+		{
+		    if (LIKELY(Success == result))
+			mtx.release();
+		}
+
+		Status status() const NOTHROW { return result; }
+		bool owns_lock() const NOTHROW { return Success == result; }
+	    };
+
 	    // Mutex::LockWithInt<> is used to hold ownership of a
 	    // Mutex during the object's lifetime along with disabling
 	    // interrupts. The single parameter of the template is the
 	    // mutex with which this lock is associated.
 
 	    template <Mutex& mtx>
-	    class LockWithInt : private Uncopyable, private NoHeap {
+	    class LockWithInt :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
 		int const prevVal;
 
 	     public:
@@ -200,7 +392,8 @@ namespace vwpp {
 	    // own it.
 
 	    template <Mutex& mtx>
-	    class Unlock : private Uncopyable, private NoHeap {
+	    class Unlock :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
 	     public:
 		explicit Unlock(Lock<mtx>&) { mtx.release(); }
 		~Unlock() NOTHROW { mtx.acquire(-1); }
@@ -213,7 +406,8 @@ namespace vwpp {
 	    // field in the class.
 
 	    template <typename T, Mutex T::*pmtx>
-	    class PMLock : private Uncopyable, private NoHeap {
+	    class PMLock :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
 		Mutex& mtx;
 
 	     public:
@@ -224,12 +418,38 @@ namespace vwpp {
 		~PMLock() NOTHROW { mtx.release(); }
 	    };
 
+	    // Mutex::PMTryLock<> is the non-throwing version of
+	    // Mutex::PMLock<>.
+
+	    template <typename T, Mutex T::*pmtx>
+	    class PMTryLock :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
+		Mutex& mtx;
+		Status const result;
+
+	     public:
+		explicit PMTryLock(T* const obj,
+				   int const tmo = -1) NOTHROW :
+		    mtx(obj->*pmtx), result(mtx.try_acquire(tmo))
+		{}
+
+		~PMTryLock() NOTHROW
+		{
+		    if (LIKELY(Success == result))
+			mtx.release();
+		}
+
+		Status status() const NOTHROW { return result; }
+		bool owns_lock() const NOTHROW { return Success == result; }
+	    };
+
 	    // Mutex::PMLockWithInt<> is used to hold ownership of a
 	    // Mutex during the object's lifetime along with disabling
 	    // interrupts.
 
 	    template <typename T, Mutex T::*pmtx>
-	    class PMLockWithInt : private Uncopyable, private NoHeap {
+	    class PMLockWithInt :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
 		Mutex& mtx;
 		int const prevVal;
 
@@ -261,7 +481,8 @@ namespace vwpp {
 	    // that you already own it.
 
 	    template <typename T, Mutex T::*pmtx>
-	    class PMUnlock : private Uncopyable, private NoHeap {
+	    class PMUnlock :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
 		Mutex& mtx;
 
 	     public:
@@ -275,6 +496,71 @@ namespace vwpp {
 	    Mutex();
 	};
 
+	// A counting semaphore which hands out units of a resource
+	// (e.g. DMA channels or bus transaction slots.) Several
+	// units can be acquired, and released, at once. The count
+	// is kept in an atomic variable so acquiring available units,
+	// and releasing units nobody is waiting for, doesn't enter
+	// the kernel. Tasks which have to wait block on a binary
+	// semaphore which is flushed whenever units are released;
+	// each woken task checks the count again. Releasing is safe
+	// from interrupt handlers.
+	//
+	// Waiters aren't served in order, so a task asking for many
+	// units can be starved by tasks asking for few.
+
+	class CountingSemaphore : public SemaphoreBase {
+	    Atomic<uint32_t> avail;
+	    Atomic<uint32_t> waiters;
+
+	    bool take(uint32_t n) NOTHROW
+	    {
+		uint32_t s = avail.load(Relaxed);
+
+		while (s >= n)
+		    if (avail.compare_exchange(s, s - n, Acquire))
+			return true;
+		return false;
+	    }
+
+	 public:
+	    explicit CountingSemaphore(uint32_t);
+	    ~CountingSemaphore() NOTHROW;
+
+	    void acquire(uint32_t = 1, int = -1);
+	    Status try_acquire(uint32_t = 1, int = -1) NOTHROW;
+	    void release(uint32_t = 1) NOTHROW;
+
+	    uint32_t available() const NOTHROW { return avail.load(Relaxed); }
+
+	    // CountingSemaphore::Permit<> holds 'N' units of a
+	    // semaphore during the object's lifetime.
+
+	    template <CountingSemaphore& sem, uint32_t N = 1>
+	    class Permit :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
+	     public:
+		explicit Permit(int tmo = -1) { sem.acquire(N, tmo); }
+		~Permit() NOTHROW { sem.release(N); }
+	    };
+
+	    // CountingSemaphore::PMPermit<> is the version of
+	    // Permit<> for semaphores which are class members.
+
+	    template <typename T, CountingSemaphore T::*psem, uint32_t N = 1>
+	    class PMPermit :
+		private v3_0::Uncopyable, private v3_0::NoHeap {
+		CountingSemaphore& sem;
+
+	     public:
+		explicit PMPermit(T* const obj, int tmo = -1) :
+		    sem(obj->*psem)
+		{ sem.acquire(N, tmo); }
+
+		~PMPermit() NOTHROW { sem.release(N); }
+	    };
+	};
+
 	// Experimental class that associates a variable with a mutex.
 	// Access to the variable is only allowed if a lock is
 	// provided proving, at compile-time, you own the required
@@ -329,25 +615,21 @@ namespace vwpp {
 	struct DetermineLock {
 	};
 
-	template <>
 	template <Mutex& mtx>
 	struct DetermineLock<Mutex::Lock<mtx> > {
 	    typedef Mutex::Lock<mtx> type;
 	};
 
-	template <>
 	template <Mutex& mtx>
 	struct DetermineLock<Mutex::LockWithInt<mtx> > {
 	    typedef Mutex::LockWithInt<mtx> type;
 	};
 
-	template <>
 	template <typename T, Mutex T::*pmtx>
 	struct DetermineLock<Mutex::PMLock<T, pmtx> > {
 	    typedef Mutex::PMLock<T, pmtx> type;
 	};
 
-	template <>
 	template <typename T, Mutex T::*pmtx>
 	struct DetermineLock<Mutex::PMLockWithInt<T, pmtx> > {
 	    typedef Mutex::PMLockWithInt<T, pmtx> type;
@@ -382,9 +664,11 @@ namespace vwpp {
 
 		if (LIKELY(OK == ::taskPriorityGet(id, &oldValue))) {
 		    if (UNLIKELY(ERROR == ::taskPrioritySet(id, Prio)))
-			throw std::runtime_error("couldn't set task priority");
+			VWPP_THROW(std::runtime_error("couldn't set task "
+						      "priority"));
 		} else
-		    throw std::runtime_error("couldn't get current task priority");
+		    VWPP_THROW(std::runtime_error("couldn't get current task "
+						  "priority"));
 	    }
 
 	    ~AbsPriority() NOTHROW { ::taskPrioritySet(::taskIdSelf(), oldValue); }
@@ -402,9 +686,11 @@ namespace vwpp {
 		if (LIKELY(OK == ::taskPriorityGet(id, &oldValue))) {
 		    if (oldValue > Prio)
 			if (UNLIKELY(ERROR == ::taskPrioritySet(id, Prio)))
-			    throw std::runtime_error("couldn't set task priority");
+			    VWPP_THROW(std::runtime_error("couldn't set task "
+							  "priority"));
 		} else
-		    throw std::runtime_error("couldn't get current task priority");
+		    VWPP_THROW(std::runtime_error("couldn't get current task "
+						  "priority"));
 	    }
 
 	    ~MinAbsPriority() NOTHROW
@@ -428,9 +714,11 @@ namespace vwpp {
 			(UNLIKELY(nv < 0) ? 0 : (UNLIKELY(nv > 255) ? 255 : nv));
 
 		    if (UNLIKELY(ERROR == ::taskPrioritySet(id, np)))
-			throw std::runtime_error("couldn't set task priority");
+			VWPP_THROW(std::runtime_error("couldn't set task "
+						      "priority"));
 		} else
-		    throw std::runtime_error("couldn't get current task priority");
+		    VWPP_THROW(std::runtime_error("couldn't get current task "
+						  "priority"));
 	    }
 
 	    ~RelPriority() NOTHROW { ::taskPrioritySet(::taskIdSelf(), oldValue); }
@@ -440,18 +728,79 @@ namespace vwpp {
 	struct TaskSignal;
 
 	class EventBase : private Uncopyable, private NoHeap {
+	    friend class Selector;
+	    friend class coro::Watch;
+
+	    // The lower bits of 'state' count the tasks inside
+	    // _wait(). 'Pending' records a signal sent while no task
+	    // was waiting; it stands in for the semaphore being full,
+	    // so signalling an idle event doesn't enter the kernel.
+	    // While the count is zero, the semaphore is kept empty.
+	    // 'Selected' is set while a Selector watches the event,
+	    // since the Selector is notified through the semaphore.
+	    // 'flushes' counts the wakeAll() calls made while the
+	    // event was selected; a watcher that sees it change knows
+	    // it was released, even if another watcher took the
+	    // signal.
+
+	    enum {
+		Pending = 0x80000000, Selected = 0x40000000,
+		Waiters = 0x3fffffff
+	    };
+
 	    semaphore* id;
+	    Atomic<uint32_t> state;
+	    Atomic<uint32_t> flushes;
+
+	    bool enter() NOTHROW;
+	    void leave() NOTHROW;
+	    void give() NOTHROW;
+	    void select(bool) NOTHROW;
 
 	 protected:
 	    EventBase();
 
 	    bool _wait(int = -1);
+	    Status _try_wait(int = -1) NOTHROW;
 
 	 public:
 	    virtual ~EventBase();
 
-	    void wakeOne() NOTHROW { ::semGive(id); }
-	    void wakeAll() NOTHROW { ::semFlush(id); }
+	    void wakeOne() NOTHROW
+	    {
+		trace::event(trace::EventWake, trace::Instant, id);
+
+		uint32_t s = state.load(Relaxed);
+
+		while (!(s & (Waiters | Selected)))
+		    if ((s & Pending) ||
+			state.compare_exchange(s, s | Pending, Release))
+			return;
+		give();
+	    }
+
+	    // wakeAll() releases the tasks blocked in wait(); a task
+	    // that waits afterwards isn't released. A selected event
+	    // is the exception: a flush doesn't make the semaphore
+	    // available, so it wouldn't notify the Selector, and the
+	    // semaphore is given as well. That signal latches like
+	    // one from wakeOne(). If no task takes it, it becomes
+	    // pending when the event is deselected (or its last
+	    // waiter leaves), and the next wait() returns at once.
+
+	    void wakeAll() NOTHROW
+	    {
+		trace::event(trace::EventWake, trace::Instant, id);
+
+		uint32_t const s = state.load(Acquire);
+
+		if (s & Waiters)
+		    ::semFlush(id);
+		if (s & Selected) {
+		    flushes.fetch_add(1, Release);
+		    ::semGive(id);
+		}
+	    }
 	};
 
 	// Default Event template. We only support two types of
@@ -465,9 +814,12 @@ namespace vwpp {
 
 	template <>
 	class Event<TaskSignal> : private EventBase {
+	    friend class Selector;
+	    friend class coro::Watch;
 
 	 public:
 	    bool wait(int tmo = -1) { return _wait(tmo); }
+	    Status try_wait(int tmo = -1) NOTHROW { return _try_wait(tmo); }
 	    void wakeOne() NOTHROW { EventBase::wakeOne(); }
 	    void wakeAll() NOTHROW { EventBase::wakeAll(); }
 	};
@@ -477,9 +829,16 @@ namespace vwpp {
 
 	template <>
 	class Event<IntSignal> : private EventBase {
+	    friend class Selector;
+	    friend class coro::Watch;
 
 	 public:
 	    bool wait(IntLock&, int tmo = -1) { return _wait(tmo); }
+
+	    Status try_wait(IntLock&, int tmo = -1) NOTHROW
+	    {
+		return _try_wait(tmo);
+	    }
 	    void wakeOne() NOTHROW { EventBase::wakeOne(); }
 	    void wakeAll() NOTHROW { EventBase::wakeAll(); }
 	};
@@ -527,15 +886,23 @@ namespace vwpp {
 	// **** message queue interface provided by VxWorks.
 
 	class QueueBase : private Uncopyable {
+	    friend class Selector;
+	    friend class coro::Watch;
+
 	    msg_q* const id;
 
 	    bool _msg_send(void const*, size_t, int, int);
+	    Status _try_msg_send(void const*, size_t, int, int) NOTHROW;
 
 	 protected:
 	    bool _pop_front(void*, size_t, int);
 	    bool _push_front(void const*, size_t, int);
 	    bool _push_back(void const*, size_t, int);
 
+	    Status _try_pop_front(void*, size_t, int) NOTHROW;
+	    Status _try_push_front(void const*, size_t, int) NOTHROW;
+	    Status _try_push_back(void const*, size_t, int) NOTHROW;
+
 	 public:
 	    QueueBase(size_t, size_t);
 	    virtual ~QueueBase() NOTHROW;
@@ -566,6 +933,673 @@ namespace vwpp {
 	    {
 		return _push_back(&tt, sizeof(T), tmo);
 	    }
+
+	    // Non-throwing versions of the above. A timeout is
+	    // reported as 'Timeout' rather than returning false.
+
+	    inline Status try_pop_front(T& tt, int tmo = -1) NOTHROW
+	    {
+		return _try_pop_front(&tt, sizeof(T), tmo);
+	    }
+
+	    inline Status try_push_front(T const& tt, int tmo = -1) NOTHROW
+	    {
+		return _try_push_front(&tt, sizeof(T), tmo);
+	    }
+
+	    inline Status try_push_back(T const& tt, int tmo = -1) NOTHROW
+	    {
+		return _try_push_back(&tt, sizeof(T), tmo);
+	    }
+	};
+
+	// The queues which are implemented in terms of semaphores,
+	// rather than VxWorks message queues, inherit this class. It
+	// converts the result of a non-throwing operation into the
+	// result of the throwing API: true for success, false for a
+	// timeout and an exception for anything else.
+
+	class QueueStatus {
+	 protected:
+	    static void _raise(Status);
+
+	    static bool _check(Status const st)
+	    {
+		if (LIKELY(Success == st))
+		    return true;
+		if (UNLIKELY(Timeout != st))
+		    _raise(st);
+		return false;
+	    }
+	};
+
+	// ObjectQueue<> is a queue for types that can't be copied as
+	// raw bytes, like Queue<> does (i.e. types with constructors,
+	// destructors or pointers to their own data.) Elements are
+	// constructed in place in storage that's part of the queue
+	// object, so no heap allocation is done after the queue is
+	// created. Popping an element moves it (or, with pre-C++11
+	// compilers, copies it) to the caller and destroys the queued
+	// instance.
+	//
+	// ObjectQueueBase manages the slots. Producers are serialized
+	// with a mutex while they construct an element; consumers
+	// while they move one out.
+
+	class ObjectQueueBase : private Uncopyable, protected QueueStatus {
+	    semaphore* const access;
+	    semaphore* const freeSlots;
+	    semaphore* const usedSlots;
+	    size_t const nSlots;
+	    size_t head;
+	    size_t used;
+
+	 protected:
+	    explicit ObjectQueueBase(size_t);
+
+	    Status _reserve(bool, int, size_t&) NOTHROW;
+	    void _commit(bool) NOTHROW;
+	    void _cancel() NOTHROW;
+
+	    Status _claim(int, size_t&) NOTHROW;
+	    void _consume() NOTHROW;
+
+	 public:
+	    virtual ~ObjectQueueBase() NOTHROW;
+
+	    size_t total() const NOTHROW { return used; }
+	};
+
+	template <typename T, size_t nn>
+	class ObjectQueue : public ObjectQueueBase {
+	    char storage[nn * sizeof(T)] __attribute__((aligned));
+
+	    T* slot(size_t const idx)
+	    {
+		return reinterpret_cast<T*>(storage) + idx;
+	    }
+
+	    // Holds a reserved slot while an element gets constructed
+	    // in it. If the constructor throws an exception, the slot
+	    // is returned to the free list.
+
+	    class Insertion {
+		ObjectQueue& q;
+		bool const front;
+		bool done;
+
+	     public:
+		Insertion(ObjectQueue& o, bool const f) :
+		    q(o), front(f), done(false) {}
+
+		~Insertion() NOTHROW
+		{
+		    if (UNLIKELY(!done))
+			q._cancel();
+		}
+
+		void commit() NOTHROW
+		{
+		    done = true;
+		    q._commit(front);
+		}
+	    };
+
+	    // Holds a claimed slot while its element gets moved out.
+	    // The element is always destroyed, even if moving it
+	    // throws an exception.
+
+	    class Removal {
+		ObjectQueue& q;
+		T* const ptr;
+
+	     public:
+		Removal(ObjectQueue& o, T* const p) : q(o), ptr(p) {}
+
+		~Removal() NOTHROW
+		{
+		    ptr->~T();
+		    q._consume();
+		}
+	    };
+
+#if __cplusplus >= 201103L
+	    template <typename... Args>
+	    Status _emplace(bool const front, int const tmo, Args&&... args)
+	    {
+		size_t idx;
+		Status const st = _reserve(front, tmo, idx);
+
+		if (LIKELY(Success == st)) {
+		    Insertion ins(*this, front);
+
+		    new (slot(idx)) T(std::forward<Args>(args)...);
+		    ins.commit();
+		}
+		return st;
+	    }
+#else
+	    Status _emplace(bool const front, int const tmo, T const& tt)
+	    {
+		size_t idx;
+		Status const st = _reserve(front, tmo, idx);
+
+		if (LIKELY(Success == st)) {
+		    Insertion ins(*this, front);
+
+		    new (slot(idx)) T(tt);
+		    ins.commit();
+		}
+		return st;
+	    }
+#endif
+
+	 public:
+	    ObjectQueue() : ObjectQueueBase(nn) {}
+
+	    ~ObjectQueue() NOTHROW
+	    {
+		size_t idx;
+
+		while (Success == _claim(0, idx)) {
+		    slot(idx)->~T();
+		    _consume();
+		}
+	    }
+
+	    Status try_pop_front(T& tt, int const tmo = -1)
+	    {
+		size_t idx;
+		Status const st = _claim(tmo, idx);
+
+		if (LIKELY(Success == st)) {
+		    Removal rem(*this, slot(idx));
+
+#if __cplusplus >= 201103L
+		    tt = std::move(*slot(idx));
+#else
+		    tt = *slot(idx);
+#endif
+		}
+		return st;
+	    }
+
+	    Status try_push_front(T const& tt, int const tmo = -1)
+	    {
+		return _emplace(true, tmo, tt);
+	    }
+
+	    Status try_push_back(T const& tt, int const tmo = -1)
+	    {
+		return _emplace(false, tmo, tt);
+	    }
+
+	    bool pop_front(T& tt, int const tmo = -1)
+	    {
+		return _check(try_pop_front(tt, tmo));
+	    }
+
+	    bool push_front(T const& tt, int const tmo = -1)
+	    {
+		return _check(_emplace(true, tmo, tt));
+	    }
+
+	    bool push_back(T const& tt, int const tmo = -1)
+	    {
+		return _check(_emplace(false, tmo, tt));
+	    }
+
+#if __cplusplus >= 201103L
+	    // These versions move the caller's object into the queue.
+
+	    Status try_push_front(T&& tt, int const tmo = -1)
+	    {
+		return _emplace(true, tmo, std::move(tt));
+	    }
+
+	    Status try_push_back(T&& tt, int const tmo = -1)
+	    {
+		return _emplace(false, tmo, std::move(tt));
+	    }
+
+	    bool push_front(T&& tt, int const tmo = -1)
+	    {
+		return _check(_emplace(true, tmo, std::move(tt)));
+	    }
+
+	    bool push_back(T&& tt, int const tmo = -1)
+	    {
+		return _check(_emplace(false, tmo, std::move(tt)));
+	    }
+
+	    // The emplace functions construct the element in the queue
+	    // using the arguments following the timeout. The timeout
+	    // comes first since the remaining arguments are forwarded
+	    // to T's constructor.
+
+	    template <typename... Args>
+	    Status try_emplace_front(int const tmo, Args&&... args)
+	    {
+		return _emplace(true, tmo, std::forward<Args>(args)...);
+	    }
+
+	    template <typename... Args>
+	    Status try_emplace_back(int const tmo, Args&&... args)
+	    {
+		return _emplace(false, tmo, std::forward<Args>(args)...);
+	    }
+
+	    template <typename... Args>
+	    bool emplace_front(int const tmo, Args&&... args)
+	    {
+		return _check(_emplace(true, tmo,
+				       std::forward<Args>(args)...));
+	    }
+
+	    template <typename... Args>
+	    bool emplace_back(int const tmo, Args&&... args)
+	    {
+		return _check(_emplace(false, tmo,
+				       std::forward<Args>(args)...));
+	    }
+#endif
+	};
+
+	// PriorityQueue<> is a queue with 'Levels' priority levels
+	// (up to 32.) Level 0 has the highest priority, like VxWorks
+	// task priorities. Each level has room for 'nn' elements so a
+	// flood of low priority requests can't prevent higher
+	// priority ones from being queued. Like Queue<>, the elements
+	// are copied as raw bytes. Adding an element is O(1) and
+	// removing one uses a bitmap of the non-empty levels to find
+	// the highest priority one in constant time.
+
+	class PriorityQueueBase : private Uncopyable, protected QueueStatus {
+	 protected:
+	    struct Level {
+		semaphore* freeSlots;
+		size_t head;
+		size_t used;
+		uint32_t pushed;
+		uint32_t timeouts;
+	    };
+
+	 private:
+	    semaphore* const access;
+	    semaphore* const usedSlots;
+	    Level* levels;
+	    size_t nLevels;
+	    size_t nSlots;
+	    size_t elemSize;
+	    uint8_t* storage;
+	    uint32_t ready;
+
+	 protected:
+	    PriorityQueueBase();
+
+	    void _init(Level*, size_t, size_t, void*, size_t);
+
+	    Status _push(size_t, void const*, int) NOTHROW;
+	    Status _pop(void*, int, size_t*) NOTHROW;
+
+	    Level const& _level(size_t) const;
+
+	 public:
+	    virtual ~PriorityQueueBase() NOTHROW;
+
+	    size_t total() const NOTHROW;
+	    size_t total(size_t const level) const { return _level(level).used; }
+
+	    // Returns the number of elements added to a level and the
+	    // number of times adding one timed out. These counters
+	    // wrap.
+
+	    uint32_t pushed(size_t const level) const
+	    {
+		return _level(level).pushed;
+	    }
+
+	    uint32_t timeouts(size_t const level) const
+	    {
+		return _level(level).timeouts;
+	    }
+	};
+
+	template <typename T, size_t Levels, size_t nn>
+	class PriorityQueue : public PriorityQueueBase {
+	    template <bool, int = 0> struct ValidLevels { };
+	    template <int Dummy> struct ValidLevels<true, Dummy> {
+		typedef ValidLevels valid;
+	    };
+
+	    typedef typename ValidLevels<(Levels > 0 && Levels <= 32)>::valid
+	    Check;
+
+	    Level info[Levels];
+	    char storage[Levels * nn * sizeof(T)] __attribute__((aligned));
+
+	 public:
+	    PriorityQueue()
+	    {
+		_init(info, Levels, nn, storage, sizeof(T));
+	    }
+
+	    // Removes the highest priority element. If 'level' isn't
+	    // null, it receives the level from which the element was
+	    // taken.
+
+	    Status try_pop_front(T& tt, int const tmo = -1,
+				 size_t* const level = 0) NOTHROW
+	    {
+		return _pop(&tt, tmo, level);
+	    }
+
+	    // Adds an element to the given level. A level outside
+	    // the queue's range makes try_push_back() return
+	    // OutOfRange and push_back() throw std::out_of_range.
+
+	    Status try_push_back(size_t const level, T const& tt,
+				 int const tmo = -1) NOTHROW
+	    {
+		return _push(level, &tt, tmo);
+	    }
+
+	    bool pop_front(T& tt, int const tmo = -1, size_t* const level = 0)
+	    {
+		return _check(_pop(&tt, tmo, level));
+	    }
+
+	    bool push_back(size_t const level, T const& tt, int const tmo = -1)
+	    {
+		return _check(_push(level, &tt, tmo));
+	    }
+	};
+
+	// LatestValue<> passes the most recent value of T from one
+	// writer to one reader using three buffers. The writer fills
+	// its private buffer and swaps it with the shared one. The
+	// reader swaps the shared buffer with its private one, but
+	// only if a new value was published since it last looked.
+	// Neither side ever locks or waits, so the writer may be an
+	// interrupt handler. If the writer publishes faster than the
+	// reader consumes, the intermediate values are overwritten;
+	// the reader always sees a complete copy of the newest one.
+
+	template <typename T>
+	class LatestValue : private Uncopyable, private NoHeap {
+	    enum { Fresh = 4, IndexMask = 3 };
+
+	    T buf[3];
+	    Atomic<uint32_t> shared;
+	    uint32_t back;
+	    uint32_t front;
+
+	 public:
+	    LatestValue() : shared(1), back(0), front(2) {}
+
+	    // The writer can fill in the buffer returned by
+	    // writeBuffer() and then call publish(), which avoids
+	    // copying large snapshots twice.
+
+	    T& writeBuffer() NOTHROW { return buf[back]; }
+
+	    void publish() NOTHROW
+	    {
+		back = shared.exchange(back | Fresh, Release) & IndexMask;
+	    }
+
+	    void publish(T const& v)
+	    {
+		buf[back] = v;
+		publish();
+	    }
+
+	    // Makes the newest value available through read(). Returns
+	    // false if nothing was published since the last call.
+
+	    bool update() NOTHROW
+	    {
+		if (!(shared.load(Relaxed) & Fresh))
+		    return false;
+		front = shared.exchange(front, Acquire) & IndexMask;
+		return true;
+	    }
+
+	    T const& read() const NOTHROW { return buf[front]; }
+
+	    // Copies the newest value to 'v' and returns true if it
+	    // hadn't been read before.
+
+	    bool read(T& v)
+	    {
+		bool const fresh = update();
+
+		v = buf[front];
+		return fresh;
+	    }
+	};
+
+	// Broadcast<> delivers every message from one producer to any
+	// number of subscribers. Messages are written once into a ring
+	// of 'nn' slots and each Subscriber keeps its own read cursor,
+	// so adding subscribers doesn't add copies. The producer never
+	// waits: a subscriber that falls more than 'nn' messages behind
+	// loses the oldest ones, which is reported by its overruns()
+	// counter. The producer may be an interrupt handler. Like
+	// Queue<>, T must be copyable as raw bytes, since a subscriber
+	// may copy a slot while the producer is overwriting it (the
+	// copy is then discarded.)
+	//
+	// Each slot holds a sequence number which is odd while the
+	// producer writes the slot. A subscriber checks it before and
+	// after copying a message to detect that it was overwritten.
+
+	template <typename T, size_t nn>
+	class Broadcast : private Uncopyable, private NoHeap {
+	    struct Slot {
+		Atomic<uint32_t> seq;
+		T data;
+	    };
+
+	    Slot slot[nn];
+	    Atomic<uint32_t> head;
+	    Event<IntSignal> ev;
+
+	 public:
+	    Broadcast() {}
+
+	    void publish(T const& v) NOTHROW
+	    {
+		uint32_t const msg = head.load(Relaxed);
+		Slot& s = slot[msg % nn];
+
+		s.seq.store(2 * msg + 1, Relaxed);
+		atomic_fence(Release);
+		s.data = v;
+		s.seq.store(2 * msg + 2, Release);
+		head.store(msg + 1, Release);
+		ev.wakeAll();
+	    }
+
+	    // A Subscriber starts receiving with the next message that
+	    // gets published after it was created.
+
+	    class Subscriber : private vwpp::v3_0::Uncopyable {
+		Broadcast& bc;
+		uint32_t cursor;
+		uint32_t lost;
+
+		// Moves the cursor to the oldest message that can
+		// still be read safely.
+
+		void skip() NOTHROW
+		{
+		    uint32_t const oldest = bc.head.load(Acquire) - nn + 1;
+
+		    if (static_cast<int32_t>(oldest - cursor) > 0) {
+			lost += oldest - cursor;
+			cursor = oldest;
+		    }
+		}
+
+	     public:
+		explicit Subscriber(Broadcast& b) :
+		    bc(b), cursor(b.head.load(Acquire)), lost(0)
+		{}
+
+		Status try_receive(T& v, int const tmo = -1)
+		{
+		    Deadline const dl(tmo);
+
+		    while (true) {
+			uint32_t const hd = bc.head.load(Acquire);
+
+			// Each wait only gets what's left of the timeout.
+			// A poll of an empty channel (or one whose
+			// timeout has run out) finds the semaphore
+			// unavailable rather than timing out.
+
+			if (cursor == hd) {
+			    IntLock lock;
+
+			    if (bc.head.load(Acquire) == cursor) {
+				Status const st =
+				    bc.ev.try_wait(lock, dl.remaining());
+
+				if (Unavailable == st)
+				    return Timeout;
+				if (Success != st)
+				    return st;
+			    }
+			    continue;
+			}
+
+			if (UNLIKELY(hd - cursor > nn)) {
+			    skip();
+			    continue;
+			}
+
+			Slot const& s = bc.slot[cursor % nn];
+			uint32_t const seq = s.seq.load(Acquire);
+
+			if (UNLIKELY(seq != 2 * cursor + 2)) {
+			    skip();
+			    continue;
+			}
+
+			v = s.data;
+			atomic_fence(Acquire);
+
+			if (UNLIKELY(s.seq.load(Relaxed) != seq)) {
+			    skip();
+			    continue;
+			}
+
+			++cursor;
+			return Success;
+		    }
+		}
+
+		// Returns true if a message was received or false if
+		// the timeout expired.
+
+		bool receive(T& v, int const tmo = -1)
+		{
+		    return Success == try_receive(v, tmo);
+		}
+
+		// Returns the number of messages that have been
+		// published but not yet received.
+
+		size_t lag() const NOTHROW
+		{
+		    return bc.head.load(Relaxed) - cursor;
+		}
+
+		// Returns the total number of messages this
+		// subscriber lost because it fell behind.
+
+		uint32_t overruns() const NOTHROW { return lost; }
+	    };
+	};
+
+	// **** This section defines the Selector, which allows a task
+	// **** to wait on several queues and events at once.
+
+	// A Selector is built on VxWorks events. Each registered
+	// source is assigned one of the 24 user event bits and, when
+	// the source becomes ready, the kernel sends that bit to the
+	// task which owns the selector. The owner is the task that
+	// created the Selector and it is the only task that may
+	// register sources or wait on it. A queue or event may only
+	// be registered with one selector at a time.
+	//
+	// A source being reported as ready is a hint; the owner should
+	// then read it without blocking (e.g. pop_front(x, 0) or
+	// wait(0)) since another task may have emptied it first. Queues
+	// which still hold messages are reported again by the next
+	// call to wait().
+	//
+	// Flag sources aren't tied to a kernel object. Any task, or an
+	// interrupt handler, marks one of them ready by calling
+	// signal().
+	//
+	// If 'fair' is true, waitOne() hands out the ready sources in
+	// round-robin order. Otherwise, the source with the lowest
+	// index is always returned first, so registration order
+	// defines priority.
+
+	class Selector : private Uncopyable, private NoHeap {
+	 public:
+	    enum { MaxSources = 24 };
+
+	 private:
+	    enum Kind { Unused, EventSource, QueueSource, FlagSource };
+
+	    struct Source {
+		Kind kind;
+		void* obj;
+	    };
+
+	    int const owner;
+	    bool const fair;
+	    size_t next;
+	    uint32_t allocated;
+	    uint32_t pending;
+	    uint32_t queues;
+	    Source src[MaxSources];
+
+	    size_t allocate(Kind, void*);
+	    size_t addEvent(EventBase&);
+	    void collect(int);
+
+	 public:
+	    explicit Selector(bool fair = false);
+	    ~Selector() NOTHROW;
+
+	    size_t add(QueueBase&);
+	    size_t add(Event<TaskSignal>& ev) { return addEvent(ev); }
+	    size_t add(Event<IntSignal>& ev) { return addEvent(ev); }
+	    size_t addFlag();
+
+	    void remove(size_t);
+
+	    void signal(size_t) const NOTHROW;
+
+	    // Blocks until at least one source is ready, or the
+	    // timeout expires, and returns a bitmask of the ready
+	    // sources (bit N is set if source N is ready.) Returns 0
+	    // if the timeout expired.
+
+	    uint32_t wait(int = -1);
+
+	    // Blocks until at least one source is ready and returns
+	    // the index of one of them. Returns -1 if the timeout
+	    // expired. Sources which were ready, but not returned,
+	    // are remembered so the following calls don't enter the
+	    // kernel.
+
+	    int waitOne(int = -1);
 	};
 
 	// **** This section defines classes that implement the VxWorks
@@ -574,6 +1608,8 @@ namespace vwpp {
 	// This class is used to create VxWorks tasks.
 
 	class Task : private Uncopyable {
+	    friend class TaskMonitor;
+
 	 private:
 	    int id;
 
@@ -584,6 +1620,7 @@ namespace vwpp {
 
 	    void delay(int) const;
 	    void yieldCpu() const { delay(0); }
+	    void kill() NOTHROW;
 
 	 public:
 	    Task();
@@ -599,11 +1636,103 @@ namespace vwpp {
 	    void suspend() const;
 
 	    void run(char const*, unsigned char, int);
+	    Status try_run(char const*, unsigned char, int) NOTHROW;
+	};
+
+	// A RestartableTask creates its VxWorks task once, with
+	// spawn(), and parks it on an Event. Each call to run() wakes
+	// the parked task, which calls jobEntry() and parks again when
+	// it returns. The stack and TCB get reused, so starting a job
+	// costs a semaphore give rather than a taskSpawn(). An
+	// exception escaping jobEntry() ends the job, but not the
+	// task.
+
+	class RestartableTask : public Task {
+	    enum State { NotSpawned, Idle, Busy };
+
+	    Atomic<State> state;
+	    Event<TaskSignal> start;
+	    Event<TaskSignal> finished;
+
+	    void taskEntry();
+
+	 protected:
+	    virtual void jobEntry() = 0;
+
+	 public:
+	    RestartableTask() : state(NotSpawned) {}
+	    ~RestartableTask() NOTHROW;
+
+	    void spawn(char const*, unsigned char, int);
+	    Status try_spawn(char const*, unsigned char, int) NOTHROW;
+
+	    // Starts a new job. The throwing version raises
+	    // std::logic_error if the task hasn't been spawned or is
+	    // still busy with the previous job. The non-throwing
+	    // version returns Unavailable in those cases.
+
+	    void run();
+	    Status try_run() NOTHROW;
+
+	    // Waits for the current job to finish. Returns false if
+	    // the timeout expired first.
+
+	    bool wait(int = -1);
+
+	    bool isBusy() const NOTHROW { return Busy == state.load(Acquire); }
 	};
 
 	// Other prototypes...
 
 	int ms_to_tick(int);
+
+	// Returns the lower 32 bits of a free-running, high resolution
+	// counter (the time base register, on PowerPC.)
+	// read_timebase64() returns the whole counter; the upper half
+	// is read before and after the lower one, and the read is
+	// retried if a carry happened in between. timebase_hz()
+	// returns the number of counts in a second and
+	// timebase_per_us() the number in a microsecond. The rate is
+	// measured against the system clock the first time it's
+	// needed, which takes a few clock ticks, so drivers should
+	// call one of them while they initialize. On other targets
+	// the counter is CLOCK_MONOTONIC in nanoseconds.
+	//
+	// timebase_per_us() truncates to a whole number of counts, so
+	// dividing by it overstates durations by up to one part in
+	// its value (1% for a 33.33 MHz time base.) That's fine for
+	// timeouts and spin limits. For measurements, use
+	// counts_to_us() or counts_to_ns() (vwpp_time.h), which scale
+	// by the exact timebase_hz().
+
+#if defined(PPC603) || defined(PPC604) || defined(PPC750) || defined(PPC7400)
+	inline uint32_t read_timebase() NOTHROW_IMPL
+	{
+	    uint32_t v;
+
+	    asm volatile ("mftb %0" : "=r"(v));
+	    return v;
+	}
+
+	inline uint64_t read_timebase64() NOTHROW_IMPL
+	{
+	    uint32_t hi, lo, tmp;
+
+	    asm volatile ("1: mftbu %0\n"
+			  "   mftb  %1\n"
+			  "   mftbu %2\n"
+			  "   cmpw  %0,%2\n"
+			  "   bne-  1b"
+			  : "=r"(hi), "=r"(lo), "=r"(tmp) : : "cc");
+	    return (static_cast<uint64_t>(hi) << 32) | lo;
+	}
+#else
+	uint32_t read_timebase() NOTHROW;
+	uint64_t read_timebase64() NOTHROW;
+#endif
+
+	uint32_t timebase_hz();
+	uint32_t timebase_per_us();
     };
 };
 
@@ -0,0 +1,368 @@
+#if !defined(__VWPP_ACQUISITION_H)
+#define __VWPP_ACQUISITION_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+#include <cstring>
+
+namespace vwpp {
+    namespace v3_0 {
+
+	namespace VME {
+
+	    // The schema of an Acquisition lists up to eight Register
+	    // types; each one becomes a column.
+	    //
+	    //    typedef Columns<Status, Current, Voltage> Schema;
+
+	    struct NoColumn;
+
+	    template <typename C1, typename C2 = NoColumn,
+		      typename C3 = NoColumn, typename C4 = NoColumn,
+		      typename C5 = NoColumn, typename C6 = NoColumn,
+		      typename C7 = NoColumn, typename C8 = NoColumn>
+	    struct Columns {
+		typedef C1 Head;
+		typedef Columns<C2, C3, C4, C5, C6, C7, C8> Tail;
+	    };
+
+	    template <>
+	    struct Columns<NoColumn> { };
+
+	    // Describes a column in the header of an exported file.
+
+	    struct ColumnInfo {
+		uint8_t space;
+		uint8_t size;
+		uint16_t reserved;
+		uint32_t offset;
+	    };
+
+	    // ColumnStore<> holds one array of 'N' values per column.
+	    // column() is overloaded on the register type, so asking
+	    // for a register that isn't in the schema doesn't compile.
+
+	    template <typename C, size_t N>
+	    struct ColumnStore : public ColumnStore<typename C::Tail, N> {
+		typedef ColumnStore<typename C::Tail, N> Base;
+		typedef typename C::Head R;
+		typedef typename R::Type Type;
+
+		enum {
+		    Count = Base::Count + 1,
+		    RowBytes = Base::RowBytes + sizeof(Type)
+		};
+
+		Type data[N];
+
+		using Base::column;
+
+		Type* column(R*) NOTHROW { return data; }
+		Type const* column(R*) const NOTHROW { return data; }
+
+		// Copies entry 'idx' of each column, in schema order.
+
+		uint8_t* pack(uint8_t* const dst, size_t const idx) const
+		    NOTHROW
+		{
+		    memcpy(dst, data + idx, sizeof(Type));
+		    return Base::pack(dst + sizeof(Type), idx);
+		}
+
+		static void describe(ColumnInfo* const info) NOTHROW
+		{
+		    info->space = R::space;
+		    info->size = sizeof(Type);
+		    info->reserved = 0;
+		    info->offset = R::RegOffset;
+		    Base::describe(info + 1);
+		}
+	    };
+
+	    template <size_t N>
+	    struct ColumnStore<Columns<NoColumn>, N> {
+		enum { Count = 0, RowBytes = 0 };
+
+		void column() const NOTHROW {}
+
+		uint8_t* pack(uint8_t* const dst, size_t) const NOTHROW
+		{
+		    return dst;
+		}
+
+		static void describe(ColumnInfo*) NOTHROW {}
+	    };
+
+	    // A range of samples, identified by sequence number. The
+	    // first sample ever recorded is number 0.
+
+	    struct SampleRange {
+		uint32_t first;
+		uint32_t count;
+	    };
+
+	    // AcquisitionBase keeps the sample count and time stamps of
+	    // an Acquisition. Time stamps are in microseconds since the
+	    // first sample was recorded, taken from the 64-bit time
+	    // base.
+	    //
+	    // One task records samples. Any number of readers may look
+	    // at them, without locking: the writer never waits, so a
+	    // reader can find that the samples it was looking at got
+	    // overwritten. Readers call intact() after using a range
+	    // to find out.
+
+	    class AcquisitionBase : private Uncopyable, private NoHeap {
+		uint64_t* const stamps;
+		size_t const depth;
+		Atomic<uint32_t> head;
+		Atomic<uint32_t> claimed;
+		uint64_t origin;
+
+		uint32_t oldest(uint32_t) const NOTHROW;
+
+	     protected:
+		AcquisitionBase(uint64_t*, size_t);
+
+		// The writer brackets each sample with these. begin()
+		// returns the new sample's sequence number.
+
+		uint32_t begin();
+		void commit() NOTHROW;
+
+		Status _writeHeader(int, ColumnInfo const*, size_t,
+				    size_t) const NOTHROW;
+		static Status _write(int, void const*, size_t) NOTHROW;
+
+	     public:
+		enum { FileMagic = 0x56574151, FileVersion = 1 };
+
+		// Returns the total number of samples recorded.
+
+		uint32_t total() const NOTHROW { return head.load(Acquire); }
+
+		// Returns the newest 'n' samples (or fewer, if there
+		// aren't as many.)
+
+		SampleRange latest(uint32_t) const NOTHROW;
+
+		// Returns the samples time-stamped in [from, to), in
+		// microseconds.
+
+		SampleRange find(uint64_t, uint64_t) const NOTHROW;
+
+		uint64_t time(uint32_t const seq) const NOTHROW
+		{
+		    return stamps[seq % depth];
+		}
+
+		// Returns true if none of the samples in 'r' has been
+		// overwritten (yet.)
+
+		bool intact(SampleRange const&) const NOTHROW;
+	    };
+
+	    // Acquisition<> keeps the last 'N' samples of the columns
+	    // given by 'Schema'. All storage is part of the object.
+	    // Each sample is recorded with a Row, usually from a
+	    // Sampler:
+	    //
+	    //    typedef Acquisition<Columns<Status, Current>, 7200> Acq;
+	    //
+	    //    {
+	    //        Acq::Row row(acq);
+	    //
+	    //        row.read<Status>(bank, lock);
+	    //        row.set<Current>(adcValue);
+	    //    }
+	    //
+	    // Every column should be set; columns that aren't keep the
+	    // value of an older sample. Readers access the columns in
+	    // place:
+	    //
+	    //    SampleRange const r = acq.find(t0, t1);
+	    //    Current::Type const* p;
+	    //    size_t const n = acq.chunk<Current>(r.first, r.count, p);
+	    //
+	    // A range which wraps around the end of the ring takes two
+	    // calls to chunk().
+
+	    template <typename Schema, size_t N>
+	    class Acquisition : public AcquisitionBase {
+		typedef ColumnStore<Schema, N> Store;
+
+		Store store;
+		uint64_t times[N];
+
+	     public:
+		enum {
+		    Depth = N, ColumnCount = Store::Count,
+		    RowBytes = sizeof(uint64_t) + Store::RowBytes
+		};
+
+		Acquisition() : AcquisitionBase(times, N) {}
+
+		class Row;
+		friend class Row;
+
+		class Row : private vwpp::v3_0::Uncopyable {
+		    Acquisition& acq;
+		    size_t const idx;
+
+		 public:
+		    explicit Row(Acquisition& a) :
+			acq(a), idx(a.begin() % N)
+		    {}
+
+		    ~Row() NOTHROW { acq.commit(); }
+
+		    template <typename R>
+		    void set(typename R::Type const& v) NOTHROW_IMPL
+		    {
+			acq.store.column(static_cast<R*>(0))[idx] = v;
+		    }
+
+		    // Reads register R from a memory bank into its
+		    // column.
+
+		    template <typename R, typename M>
+		    void read(M const& mem)
+		    {
+			set<R>(mem.template get<R>());
+		    }
+
+		    template <typename R, typename M, typename L>
+		    void read(M const& mem, L const& lock)
+		    {
+			set<R>(mem.template get<R>(lock));
+		    }
+		};
+
+		template <typename R>
+		typename R::Type const& at(uint32_t const seq) const
+		    NOTHROW_IMPL
+		{
+		    return store.column(static_cast<R*>(0))[seq % N];
+		}
+
+		// Points 'p' at sample 'seq' of column R and returns how
+		// many of the 'count' samples starting there are
+		// contiguous.
+
+		template <typename R>
+		size_t chunk(uint32_t const seq, uint32_t const count,
+			     typename R::Type const*& p) const NOTHROW_IMPL
+		{
+		    size_t const idx = seq % N;
+
+		    p = store.column(static_cast<R*>(0)) + idx;
+		    return count < N - idx ? count : N - idx;
+		}
+
+		// Starts an export file: a header giving the format,
+		// followed by the column descriptions.
+
+		Status writeHeader(int const fd) const NOTHROW
+		{
+		    ColumnInfo info[ColumnCount];
+
+		    Store::describe(info);
+		    return _writeHeader(fd, info, ColumnCount, RowBytes);
+		}
+
+		// Appends the samples recorded since 'next' to an
+		// export file and advances 'next'. Each record holds
+		// the time stamp and the columns, in schema order,
+		// without padding. Samples overwritten before they
+		// could be exported are skipped; 'lost' counts them.
+
+		Status stream(int const fd, uint32_t& next,
+			      uint32_t& lost) const NOTHROW
+		{
+		    enum { Batch = 16 };
+
+		    uint8_t buf[Batch * RowBytes];
+		    uint32_t const end = total();
+		    SampleRange const avail = latest(N);
+
+		    if (static_cast<int32_t>(avail.first - next) > 0) {
+			lost += avail.first - next;
+			next = avail.first;
+		    }
+
+		    while (next != end) {
+			uint8_t* ptr = buf;
+			uint32_t const start = next;
+
+			while (next != end && ptr != buf + sizeof(buf)) {
+			    uint64_t const t = time(next);
+
+			    memcpy(ptr, &t, sizeof(t));
+			    ptr = store.pack(ptr + sizeof(t), next % N);
+			    ++next;
+			}
+
+			SampleRange r = { start, next - start };
+
+			// Drop the batch if the writer caught up with
+			// it while it was being copied.
+
+			if (!intact(r)) {
+			    lost += r.count;
+			    continue;
+			}
+
+			Status const s = _write(fd, buf, ptr - buf);
+
+			if (Success != s)
+			    return s;
+		    }
+		    return Success;
+		}
+	    };
+
+	    // Sampler runs sample() every 'period' milliseconds
+	    // (rounded to clock ticks.) Wake-ups are scheduled against
+	    // absolute tick counts, so lateness in one cycle doesn't
+	    // shift the following ones. If sample() takes longer than
+	    // a period, the missed cycles are skipped and counted as
+	    // overruns. Derived classes should call stop() in their
+	    // destructor.
+
+	    class Sampler : public Task {
+		int ticks;
+		uint32_t overrunCount;
+		uint32_t jitterUs;
+
+		void taskEntry();
+
+	     protected:
+		virtual void sample() = 0;
+
+	     public:
+		Sampler() : ticks(1), overrunCount(0), jitterUs(0) {}
+
+		void start(char const*, int, unsigned char = 50, int = 8192);
+		void stop() NOTHROW { kill(); }
+
+		uint32_t overruns() const NOTHROW { return overrunCount; }
+
+		// Returns the largest difference, in microseconds,
+		// between the time between two samples and the
+		// period.
+
+		uint32_t maxJitter() const NOTHROW { return jitterUs; }
+	    };
+	};
+    };
+};
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
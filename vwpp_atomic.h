@@ -0,0 +1,498 @@
+#if !defined(__VWPP_ATOMIC_H)
+#define __VWPP_ATOMIC_H
+
+// This header gets included by vwpp.h after the barrier primitives
+// are defined. It shouldn't be included directly.
+
+// Cache line size of the target. Objects that get written at high
+// rates by different CPUs (or by a CPU and a bus master) should be
+// padded to this size so they don't share a line.
+
+#if !defined(VWPP_CACHE_LINE)
+#if defined(PPC603) || defined(PPC604) || defined(PPC750) || defined(PPC7400)
+#define VWPP_CACHE_LINE		32
+#else
+#define VWPP_CACHE_LINE		64
+#endif
+#endif
+
+// The maximum number of CPUs that per-CPU data structures need to
+// support. Non-SMP kernels only ever run on CPU 0.
+
+#if !defined(VWPP_MAX_CPUS)
+#if defined(_WRS_CONFIG_SMP)
+#define VWPP_MAX_CPUS		4
+#else
+#define VWPP_MAX_CPUS		1
+#endif
+#endif
+
+#if defined(_WRS_CONFIG_SMP) && !defined(__INCvxCpuLibh)
+
+extern "C" {
+    unsigned int vxCpuIndexGet() NOTHROW;
+}
+
+#endif
+
+#if !(defined(PPC603) || defined(PPC604) || defined(PPC750) || \
+      defined(PPC7400))
+#include <atomic>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// Returns the index of the CPU running the caller. On
+	// uniprocessor kernels, this is always 0.
+
+	inline unsigned cpu_index() NOTHROW_IMPL
+	{
+#if defined(_WRS_CONFIG_SMP)
+	    return ::vxCpuIndexGet();
+#else
+	    return 0;
+#endif
+	}
+
+	// Specifies the ordering constraints of an atomic
+	// operation. These have the same meaning as the C++11
+	// std::memory_order values.
+
+	enum MemoryOrder { Relaxed, Acquire, Release, AcqRel, SeqCst };
+
+	namespace atomic_ops {
+
+	    // This template only has a definition for types which
+	    // can be operated on with lwarx/stwcx. Both versions of
+	    // Atomic<> check their type against it, so using one
+	    // that the PowerPC can't handle (bool, a 16-bit integer
+	    // or a 64-bit integer, for instance) is a compile error
+	    // on the host too. Pointers are always accepted, even
+	    // though they're 64 bits wide on a 64-bit host.
+
+	    template <size_t N>
+	    struct Supported { };
+
+	    template <>
+	    struct Supported<4> { typedef uint32_t type; };
+
+	    template <typename T>
+	    struct Portable : public Supported<sizeof(T)> { };
+
+	    template <typename T>
+	    struct Portable<T*> { typedef T* type; };
+	};
+
+#if defined(PPC603) || defined(PPC604) || defined(PPC750) || defined(PPC7400)
+
+	// These functions implement the read-modify-write
+	// operations on 32-bit words using the lwarx/stwcx.
+	// reservation instructions. None of them contain barriers;
+	// the Atomic<> template adds the ones required by the
+	// requested memory order.
+
+	namespace atomic_ops {
+
+	    inline uint32_t swap(uint32_t volatile* const p,
+				 uint32_t const v) NOTHROW_IMPL
+	    {
+		uint32_t old;
+
+		asm volatile ("1:\tlwarx\t%0,0,%2\n\t"
+			      "stwcx.\t%3,0,%2\n\t"
+			      "bne-\t1b"
+			      : "=&r" (old), "+m" (*p)
+			      : "r" (p), "r" (v)
+			      : "cc", "memory");
+		return old;
+	    }
+
+	    inline uint32_t cas(uint32_t volatile* const p,
+				uint32_t const expected,
+				uint32_t const desired) NOTHROW_IMPL
+	    {
+		uint32_t old;
+
+		asm volatile ("1:\tlwarx\t%0,0,%2\n\t"
+			      "cmpw\t%0,%3\n\t"
+			      "bne-\t2f\n\t"
+			      "stwcx.\t%4,0,%2\n\t"
+			      "bne-\t1b\n"
+			      "2:"
+			      : "=&r" (old), "+m" (*p)
+			      : "r" (p), "r" (expected), "r" (desired)
+			      : "cc", "memory");
+		return old;
+	    }
+
+	    inline uint32_t fetch_add(uint32_t volatile* const p,
+				      uint32_t const v) NOTHROW_IMPL
+	    {
+		uint32_t old, tmp;
+
+		asm volatile ("1:\tlwarx\t%0,0,%3\n\t"
+			      "add\t%1,%0,%4\n\t"
+			      "stwcx.\t%1,0,%3\n\t"
+			      "bne-\t1b"
+			      : "=&r" (old), "=&r" (tmp), "+m" (*p)
+			      : "r" (p), "r" (v)
+			      : "cc", "memory");
+		return old;
+	    }
+
+	    inline uint32_t fetch_or(uint32_t volatile* const p,
+				     uint32_t const v) NOTHROW_IMPL
+	    {
+		uint32_t old, tmp;
+
+		asm volatile ("1:\tlwarx\t%0,0,%3\n\t"
+			      "or\t%1,%0,%4\n\t"
+			      "stwcx.\t%1,0,%3\n\t"
+			      "bne-\t1b"
+			      : "=&r" (old), "=&r" (tmp), "+m" (*p)
+			      : "r" (p), "r" (v)
+			      : "cc", "memory");
+		return old;
+	    }
+
+	    inline uint32_t fetch_and(uint32_t volatile* const p,
+				      uint32_t const v) NOTHROW_IMPL
+	    {
+		uint32_t old, tmp;
+
+		asm volatile ("1:\tlwarx\t%0,0,%3\n\t"
+			      "and\t%1,%0,%4\n\t"
+			      "stwcx.\t%1,0,%3\n\t"
+			      "bne-\t1b"
+			      : "=&r" (old), "=&r" (tmp), "+m" (*p)
+			      : "r" (p), "r" (v)
+			      : "cc", "memory");
+		return old;
+	    }
+
+	    // A plain load followed by a compare-and-branch to
+	    // itself. Following this with an 'isync' prevents any
+	    // later access from being performed before the load
+	    // completes, which is cheaper than a full 'sync'.
+
+	    inline uint32_t load_acquire(uint32_t const volatile* const p)
+		NOTHROW_IMPL
+	    {
+		uint32_t v;
+
+		asm volatile ("lwz%U1%X1\t%0,%1\n\t"
+			      "cmpw\t%0,%0\n\t"
+			      "bne-\t1f\n"
+			      "1:\tisync"
+			      : "=r" (v)
+			      : "m" (*p)
+			      : "cc", "memory");
+		return v;
+	    }
+
+	    // Issue the barrier needed before an operation with the
+	    // specified ordering.
+
+	    inline void pre_barrier(MemoryOrder const mo) NOTHROW_IMPL
+	    {
+		if (mo == Release || mo == AcqRel || mo == SeqCst)
+		    global_sync();
+		else
+		    optimizer_barrier();
+	    }
+
+	    // Issue the barrier needed after a read-modify-write
+	    // operation with the specified ordering. The operations
+	    // above end in a conditional branch so an 'isync' is
+	    // enough to give acquire semantics.
+
+	    inline void post_barrier(MemoryOrder const mo) NOTHROW_IMPL
+	    {
+		if (mo == Acquire || mo == AcqRel || mo == SeqCst)
+		    instruction_sync();
+		else
+		    optimizer_barrier();
+	    }
+	};
+
+	// Orders the memory accesses around the call as specified by
+	// 'mo', independently of any atomic operation.
+
+	inline void atomic_fence(MemoryOrder const mo) NOTHROW_IMPL
+	{
+	    if (mo == Relaxed)
+		optimizer_barrier();
+	    else
+		global_sync();
+	}
+
+	// Atomic<> holds a value that can be accessed by several
+	// tasks, CPUs, or interrupt handlers without the need of a
+	// lock. Only 32-bit types (integers, enumerations and
+	// pointers) are supported, on every target. The fetch_*
+	// methods only make sense for integer types.
+	//
+	// The store() method is implemented with a reservation,
+	// rather than a plain store, so a store from an interrupt
+	// handler always cancels a read-modify-write sequence the
+	// interrupted task has in progress.
+
+	template <typename T>
+	class Atomic : private Uncopyable {
+	    typedef typename atomic_ops::Supported<sizeof(T)>::type Word;
+
+	    union Cvt {
+		T t;
+		Word w;
+	    };
+
+	    Word volatile value;
+
+	    static Word toWord(T const v) NOTHROW
+	    {
+		Cvt tmp;
+
+		tmp.t = v;
+		return tmp.w;
+	    }
+
+	    static T fromWord(Word const v) NOTHROW
+	    {
+		Cvt tmp;
+
+		tmp.w = v;
+		return tmp.t;
+	    }
+
+	 public:
+	    Atomic() NOTHROW : value(0) {}
+	    explicit Atomic(T const v) NOTHROW : value(toWord(v)) {}
+
+	    T load(MemoryOrder const mo = SeqCst) const NOTHROW
+	    {
+		if (mo == Relaxed || mo == Release)
+		    return fromWord(value);
+		if (mo == SeqCst)
+		    global_sync();
+		return fromWord(atomic_ops::load_acquire(&value));
+	    }
+
+	    void store(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		atomic_ops::pre_barrier(mo);
+		atomic_ops::swap(&value, toWord(v));
+		if (mo == SeqCst)
+		    global_sync();
+	    }
+
+	    T exchange(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		atomic_ops::pre_barrier(mo);
+
+		Word const old = atomic_ops::swap(&value, toWord(v));
+
+		atomic_ops::post_barrier(mo);
+		return fromWord(old);
+	    }
+
+	    // If the current value equals 'expected', replace it with
+	    // 'desired' and return true. Otherwise, 'expected' is
+	    // updated with the current value and false is returned.
+
+	    bool compare_exchange(T& expected, T const desired,
+				  MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		Word const exp = toWord(expected);
+
+		atomic_ops::pre_barrier(mo);
+
+		Word const old = atomic_ops::cas(&value, exp, toWord(desired));
+
+		atomic_ops::post_barrier(mo);
+
+		if (LIKELY(old == exp))
+		    return true;
+		expected = fromWord(old);
+		return false;
+	    }
+
+	    T fetch_add(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		atomic_ops::pre_barrier(mo);
+
+		Word const old = atomic_ops::fetch_add(&value, toWord(v));
+
+		atomic_ops::post_barrier(mo);
+		return fromWord(old);
+	    }
+
+	    T fetch_sub(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		atomic_ops::pre_barrier(mo);
+
+		Word const old = atomic_ops::fetch_add(&value, -toWord(v));
+
+		atomic_ops::post_barrier(mo);
+		return fromWord(old);
+	    }
+
+	    T fetch_or(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		atomic_ops::pre_barrier(mo);
+
+		Word const old = atomic_ops::fetch_or(&value, toWord(v));
+
+		atomic_ops::post_barrier(mo);
+		return fromWord(old);
+	    }
+
+	    T fetch_and(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		atomic_ops::pre_barrier(mo);
+
+		Word const old = atomic_ops::fetch_and(&value, toWord(v));
+
+		atomic_ops::post_barrier(mo);
+		return fromWord(old);
+	    }
+	};
+
+#else
+
+	// On the host, Atomic<> is a thin wrapper around
+	// std::atomic<> so it provides the same API as the PowerPC
+	// version.
+
+	namespace atomic_ops {
+
+	    inline std::memory_order xlat(MemoryOrder const mo) NOTHROW_IMPL
+	    {
+		switch (mo) {
+		 case Relaxed: return std::memory_order_relaxed;
+		 case Acquire: return std::memory_order_acquire;
+		 case Release: return std::memory_order_release;
+		 case AcqRel: return std::memory_order_acq_rel;
+		 default: return std::memory_order_seq_cst;
+		}
+	    }
+
+	    // Loads can't have release semantics and stores can't
+	    // have acquire semantics. These adjust the order to the
+	    // closest valid one.
+
+	    inline std::memory_order xlatLoad(MemoryOrder const mo) NOTHROW_IMPL
+	    {
+		return mo == Release ? std::memory_order_relaxed :
+		    (mo == AcqRel ? std::memory_order_acquire : xlat(mo));
+	    }
+
+	    inline std::memory_order xlatStore(MemoryOrder const mo) NOTHROW_IMPL
+	    {
+		return mo == Acquire ? std::memory_order_relaxed :
+		    (mo == AcqRel ? std::memory_order_release : xlat(mo));
+	    }
+	};
+
+	inline void atomic_fence(MemoryOrder const mo) NOTHROW_IMPL
+	{
+	    std::atomic_thread_fence(atomic_ops::xlat(mo));
+	}
+
+	template <typename T>
+	class Atomic : private Uncopyable {
+	    typedef typename atomic_ops::Portable<T>::type Valid;
+
+	    std::atomic<T> value;
+
+	 public:
+	    Atomic() NOTHROW : value(T()) {}
+	    explicit Atomic(T const v) NOTHROW : value(v) {}
+
+	    T load(MemoryOrder const mo = SeqCst) const NOTHROW
+	    { return value.load(atomic_ops::xlatLoad(mo)); }
+
+	    void store(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    { value.store(v, atomic_ops::xlatStore(mo)); }
+
+	    T exchange(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    { return value.exchange(v, atomic_ops::xlat(mo)); }
+
+	    bool compare_exchange(T& expected, T const desired,
+				  MemoryOrder const mo = SeqCst) NOTHROW
+	    {
+		return value.compare_exchange_strong(expected, desired,
+						     atomic_ops::xlat(mo),
+						     atomic_ops::xlatLoad(mo));
+	    }
+
+	    T fetch_add(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    { return value.fetch_add(v, atomic_ops::xlat(mo)); }
+
+	    T fetch_sub(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    { return value.fetch_sub(v, atomic_ops::xlat(mo)); }
+
+	    T fetch_or(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    { return value.fetch_or(v, atomic_ops::xlat(mo)); }
+
+	    T fetch_and(T const v, MemoryOrder const mo = SeqCst) NOTHROW
+	    { return value.fetch_and(v, atomic_ops::xlat(mo)); }
+	};
+
+#endif
+
+	// PerCpuCounter is used for statistics that get updated at a
+	// high rate. Each CPU increments its own, cache-line
+	// aligned, slot so updates never contend with each other.
+	// The total is only computed when somebody asks for it.
+	// Like all 32-bit counters, the value wraps so readers
+	// should work with the difference of two samples.
+
+	class PerCpuCounter : private Uncopyable {
+	    struct Slot {
+		Atomic<uint32_t> count;
+	    } __attribute__((aligned(VWPP_CACHE_LINE)));
+
+	    Slot slot[VWPP_MAX_CPUS];
+
+	 public:
+	    PerCpuCounter() NOTHROW {}
+
+	    void increment() NOTHROW { add(1); }
+
+	    void add(uint32_t const n) NOTHROW
+	    {
+		slot[cpu_index()].count.fetch_add(n, Relaxed);
+	    }
+
+	    uint32_t sum() const NOTHROW
+	    {
+		uint32_t total = 0;
+
+		for (size_t ii = 0; ii < VWPP_MAX_CPUS; ++ii)
+		    total += slot[ii].count.load(Relaxed);
+		return total;
+	    }
+
+	    // Returns the current total and resets the counter. An
+	    // update occurring during the reset will be counted in
+	    // either this total or the next one, but it won't get
+	    // lost.
+
+	    uint32_t reset() NOTHROW
+	    {
+		uint32_t total = 0;
+
+		for (size_t ii = 0; ii < VWPP_MAX_CPUS; ++ii)
+		    total += slot[ii].count.exchange(0, Relaxed);
+		return total;
+	    }
+	};
+    };
+};
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
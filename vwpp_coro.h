@@ -0,0 +1,786 @@
+#if !defined(__VWPP_CORO_H)
+#define __VWPP_CORO_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#include "./vwpp_pool.h"
+#else
+#include <vwpp-3.0.h>
+#include <vwpp_pool-3.0.h>
+#endif
+
+// Coroutines need C++20. The rest of vwpp is built with older
+// compilers, so everything here is defined in the header and this
+// file is empty for them.
+
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <cstddef>
+#include <type_traits>
+#include <eventLib.h>
+#include <msgQEvLib.h>
+#include <semEvLib.h>
+#include <taskLib.h>
+#include <tickLib.h>
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// This name space lets many small state machines (e.g. one
+	// per device) run as coroutines inside a single Task, instead
+	// of each needing a Task and a stack of its own. A coroutine
+	// returns coro::Job and takes the Scheduler which runs it as a
+	// parameter; its frame is allocated from the scheduler's
+	// BlockPool, so there's no heap use after initialization.
+	// Calling the coroutine queues it on the scheduler.
+	//
+	//    coro::Job poll(coro::SchedulerBase&, Device& dev)
+	//    {
+	//        uint32_t cmd;
+	//
+	//        while (true) {
+	//            Status const s = co_await coro::pop_front(dev.cmdQ,
+	//                                                      cmd, 500);
+	//
+	//            if (Success == s)
+	//                dev.handle(cmd);
+	//            else
+	//                dev.idle();
+	//        }
+	//    }
+	//
+	// (g++ 12 misplaces the promise of a coroutine that has a
+	// co_await in an if statement's condition, so the result is
+	// stored first.)
+	//
+	//    coro::Scheduler<512, 1000> sched;
+	//
+	//    sched.run("tDevCoro", 60, 16384);
+	//    for (size_t ii = 0; ii < nDevices; ++ii)
+	//        poll(sched, dev[ii]);
+	//
+	// The scheduling is cooperative: a coroutine runs until it
+	// co_awaits, so it must not call blocking vwpp operations. The
+	// awaitables below try their resource without blocking. While
+	// coroutines wait, the scheduler's task registers for the
+	// VxWorks events of their queues and events (as a Selector
+	// does) and blocks in eventReceive(), so an idle scheduler
+	// costs nothing until a resource becomes ready or a timeout
+	// expires. A resource that's already registered by another
+	// task (e.g. watched by a Selector) can't send the scheduler
+	// events; it's checked once a clock tick instead. Calling
+	// notify() (which interrupt handlers may do) makes the
+	// scheduler check its coroutines right away.
+
+	namespace coro {
+
+	    // A suspended coroutine. The scheduler resumes it when
+	    // poll() returns true or when its timeout, in ticks,
+	    // expires. While it waits, arm() is asked to have the
+	    // resource send VxWorks event 'ev' to the scheduler's task
+	    // when it becomes ready, and disarm() undoes that once the
+	    // coroutine resumes. arm() returns false if it can't, which
+	    // makes the scheduler poll the node every tick. Nodes which
+	    // wait on something that only changes when a coroutine
+	    // runs need neither.
+
+	    class WaitNode {
+		friend class SchedulerBase;
+
+		WaitNode* next;
+		std::coroutine_handle<> handle;
+		int ticks;
+		unsigned long start;
+		bool armed;
+
+	     protected:
+		bool expired;
+
+		explicit WaitNode(int const tmo = -1) :
+		    next(0), ticks(ms_to_tick(tmo)), start(0), armed(false),
+		    expired(false)
+		{}
+
+		~WaitNode() {}
+
+	     public:
+		virtual bool poll() NOTHROW = 0;
+		virtual bool arm(uint32_t) NOTHROW { return true; }
+		virtual void disarm() NOTHROW {}
+
+		// Nodes waiting on the same resource return the same,
+		// non-null, key. Disarming one of them unregisters the
+		// others, too.
+
+		virtual void const* resource() const NOTHROW { return 0; }
+
+		// A resource tried without waiting reports Unavailable
+		// (or Timeout) when it isn't ready.
+
+		static bool busy(Status const s) NOTHROW
+		{
+		    return Timeout == s || Unavailable == s;
+		}
+
+		// Records the coroutine before it's queued.
+
+		void prepare(std::coroutine_handle<> const h) NOTHROW
+		{
+		    handle = h;
+		    start = ::tickGet();
+		}
+	    };
+
+	    // Registers the scheduler's task for the events of vwpp's
+	    // queues and events. Events are selected while they're
+	    // watched, so their signals go through the semaphore,
+	    // which is what sends the VxWorks event.
+
+	    class Watch {
+	     public:
+		static bool start(QueueBase& q, uint32_t const ev) NOTHROW
+		{
+		    return OK == ::msgQEvStart(q.id, ev, EVENTS_SEND_IF_FREE);
+		}
+
+		static void stop(QueueBase& q) NOTHROW { ::msgQEvStop(q.id); }
+
+		static void const* key(QueueBase& q) NOTHROW { return q.id; }
+
+		template <typename T>
+		static bool start(Event<T>& e, uint32_t const ev) NOTHROW_IMPL
+		{
+		    EventBase& b = e;
+
+		    if (ERROR == ::semEvStart(b.id, ev, EVENTS_SEND_IF_FREE))
+			return false;
+		    b.select(true);
+		    return true;
+		}
+
+		template <typename T>
+		static void stop(Event<T>& e) NOTHROW_IMPL
+		{
+		    EventBase& b = e;
+
+		    ::semEvStop(b.id);
+		    b.select(false);
+		}
+
+		template <typename T>
+		static void const* key(Event<T>& e) NOTHROW_IMPL
+		{
+		    EventBase& b = e;
+
+		    return b.id;
+		}
+
+		template <typename T>
+		static uint32_t flushes(Event<T>& e) NOTHROW_IMPL
+		{
+		    EventBase& b = e;
+
+		    return b.flushes.load(Acquire);
+		}
+
+		// A mutex can't send VxWorks events, so it's only
+		// tried.
+
+		static Status try_acquire(v3_0::Mutex& m) NOTHROW
+		{
+		    return m.try_acquire(0);
+		}
+
+		static void release(v3_0::Mutex& m) NOTHROW { m.release(); }
+	    };
+
+	    // The SchedulerBase is the Task that runs the coroutines.
+	    // Scheduler<> adds the frame pool.
+
+	    class SchedulerBase : public Task {
+		enum { Header = alignof(std::max_align_t) };
+
+		// The VxWorks events the scheduler's task waits for:
+		// 'Kick' is sent by post() and notify(), 'Ready' by the
+		// resources the coroutines wait on.
+
+		enum { Kick = 1u << 0, Ready = 1u << 1 };
+
+		BlockPoolBase& pool;
+		WaitNode* waiting;
+		WaitNode* incoming;
+		Atomic<int> owner;
+
+		// Unregisters a node which is about to resume. Other
+		// nodes waiting on the same resource lost their
+		// registration with it, so they're marked to register
+		// again.
+
+		void release(WaitNode& n) NOTHROW
+		{
+		    n.disarm();
+		    n.armed = false;
+
+		    void const* const key = n.resource();
+
+		    if (key)
+			for (WaitNode* ptr = waiting; ptr; ptr = ptr->next)
+			    if (ptr->resource() == key)
+				ptr->armed = false;
+		}
+
+		// Moves the coroutines that can run to a list of their
+		// own, in FIFO order, before resuming them, since they
+		// will add themselves to 'waiting' again when they
+		// suspend. The ones left waiting are registered for
+		// events and 'sleep' is set to the number of ticks the
+		// scheduler may block (-1 means until an event
+		// arrives.)
+
+		WaitNode* collect(int& sleep) NOTHROW
+		{
+		    unsigned long const now = ::tickGet();
+		    WaitNode* run = 0;
+		    WaitNode** tail = &run;
+
+		    for (WaitNode** ptr = &waiting; *ptr;) {
+			WaitNode* const n = *ptr;
+
+			if (n->poll() ||
+			    (n->expired = (n->ticks >= 0 &&
+					   now - n->start >=
+					   static_cast<unsigned long>
+					   (n->ticks)))) {
+			    *ptr = n->next;
+			    n->next = 0;
+			    *tail = n;
+			    tail = &n->next;
+			    if (n->armed)
+				release(*n);
+			} else
+			    ptr = &n->next;
+		    }
+
+		    sleep = -1;
+		    for (WaitNode* n = waiting; n; n = n->next) {
+			int left = -1;
+
+			if (n->ticks >= 0)
+			    left = n->ticks - static_cast<int>(now - n->start);
+			if (!n->armed && !(n->armed = n->arm(Ready)))
+			    left = 1;
+			if (left >= 0 && (sleep < 0 || left < sleep))
+			    sleep = left;
+		    }
+		    return run;
+		}
+
+		void taskEntry()
+		{
+		    owner.store(::taskIdSelf(), Release);
+		    while (true) {
+			{
+			    IntLock lock;
+
+			    while (WaitNode* const n = incoming) {
+				incoming = n->next;
+				n->next = waiting;
+				waiting = n;
+			    }
+			}
+
+			int sleep;
+			WaitNode* run = collect(sleep);
+
+			if (!run) {
+			    UINT32 events;
+
+			    if (!incoming)
+				::eventReceive(Kick | Ready, EVENTS_WAIT_ANY,
+					       sleep < 0 ? WAIT_FOREVER : sleep,
+					       &events);
+			    continue;
+			}
+
+			// The node lives in the coroutine's frame, which
+			// may be gone once it has been resumed.
+
+			while (WaitNode* const n = run) {
+			    run = n->next;
+			    n->handle.resume();
+			}
+		    }
+		}
+
+	     protected:
+		explicit SchedulerBase(BlockPoolBase& p) :
+		    pool(p), waiting(0), incoming(0), owner(0)
+		{}
+
+	     public:
+		~SchedulerBase() NOTHROW { kill(); }
+
+		// Allocates a coroutine frame. The pool is recorded in
+		// front of the frame so it can be released without a
+		// reference to the scheduler.
+
+		void* allocate(size_t const sz) NOTHROW
+		{
+		    if (sz + Header > pool.blockSize())
+			return 0;
+
+		    void* const blk = pool.allocate();
+
+		    if (!blk)
+			return 0;
+		    *static_cast<BlockPoolBase**>(blk) = &pool;
+		    return static_cast<uint8_t*>(blk) + Header;
+		}
+
+		static void deallocate(void* const ptr) NOTHROW
+		{
+		    uint8_t* const blk = static_cast<uint8_t*>(ptr) - Header;
+
+		    (*reinterpret_cast<BlockPoolBase**>(blk))->deallocate(blk);
+		}
+
+		// Queues a suspended coroutine. These are used by the
+		// awaitables; suspend() is called by the scheduler's
+		// task, post() by any task.
+
+		void suspend(WaitNode& n) NOTHROW
+		{
+		    n.next = waiting;
+		    waiting = &n;
+		}
+
+		void post(WaitNode& n) NOTHROW
+		{
+		    {
+			IntLock lock;
+
+			n.next = incoming;
+			incoming = &n;
+		    }
+		    notify();
+		}
+
+		// Makes the scheduler check its coroutines right away.
+		// This may be called by interrupt handlers. Until the
+		// scheduler's task starts, there's nobody to notify; it
+		// checks everything as it starts.
+
+		void notify() NOTHROW
+		{
+		    int const id = owner.load(Acquire);
+
+		    if (id)
+			::eventSend(id, Kick);
+		}
+
+		// Returns the number of frames in use, i.e. the number
+		// of live coroutines.
+
+		size_t frames() const NOTHROW { return pool.inUse(); }
+	    };
+
+	    // Scheduler<> provides room for 'Count' coroutine frames
+	    // of up to 'FrameSize' bytes. The size of a frame depends
+	    // on the coroutine's local variables; a coroutine whose
+	    // frame doesn't fit, or which is started when the pool is
+	    // empty, doesn't run and its Job is invalid.
+
+	    template <size_t FrameSize, size_t Count>
+	    class Scheduler : public SchedulerBase {
+		BlockPool<FrameSize + alignof(std::max_align_t), Count> storage;
+
+	     public:
+		Scheduler() : SchedulerBase(storage) {}
+	    };
+
+	    // The return type of coroutines run by a Scheduler. The
+	    // coroutine is started when it's called and its frame is
+	    // released when it returns; the Job only tells whether it
+	    // got started. An exception escaping the coroutine ends
+	    // it.
+
+	    class Job {
+		bool ok;
+
+		explicit Job(bool const v) : ok(v) {}
+
+	     public:
+		class promise_type {
+		    // Makes the new coroutine runnable.
+
+		    struct Launch : public WaitNode {
+			bool poll() NOTHROW { return true; }
+		    };
+
+		    Launch launch;
+
+		    struct Start {
+			bool await_ready() const noexcept { return false; }
+
+			void await_suspend(std::coroutine_handle<promise_type>
+					   const h) const noexcept
+			{
+			    promise_type& p = h.promise();
+
+			    p.launch.prepare(h);
+			    p.sched->post(p.launch);
+			}
+
+			void await_resume() const noexcept {}
+		    };
+
+		    template <typename A, typename... Rest>
+		    static SchedulerBase* find(A& a, Rest&... rest) noexcept
+		    {
+			if constexpr (std::is_base_of_v<SchedulerBase, A>)
+			    return &a;
+			else
+			    return find(rest...);
+		    }
+
+		    static SchedulerBase* find() noexcept { return 0; }
+
+		    template <typename... Args>
+		    static constexpr bool hasScheduler()
+		    {
+			return (std::is_base_of_v<SchedulerBase,
+						  std::remove_cvref_t<Args> > ||
+				...);
+		    }
+
+		 public:
+		    SchedulerBase* const sched;
+
+		    // The scheduler is found among the coroutine's
+		    // parameters (after the object, for a member
+		    // function.)
+
+		    template <typename... Args>
+		    static void* operator new(size_t const sz,
+					      Args&... args) noexcept
+		    {
+			static_assert(hasScheduler<Args...>(),
+				      "coroutine needs a Scheduler parameter");
+			return find(args...)->allocate(sz);
+		    }
+
+		    static void operator delete(void* const ptr) noexcept
+		    {
+			SchedulerBase::deallocate(ptr);
+		    }
+
+		    template <typename... Args>
+		    explicit promise_type(Args&... args) noexcept :
+			sched(find(args...))
+		    {}
+
+		    Job get_return_object() noexcept { return Job(true); }
+
+		    static Job get_return_object_on_allocation_failure()
+			noexcept
+		    {
+			return Job(false);
+		    }
+
+		    Start initial_suspend() const noexcept { return Start(); }
+
+		    std::suspend_never final_suspend() const noexcept
+		    {
+			return std::suspend_never();
+		    }
+
+		    void return_void() const noexcept {}
+		    void unhandled_exception() const noexcept {}
+		};
+
+		bool valid() const NOTHROW { return ok; }
+	    };
+
+	    // The base of the awaitables. await_ready() tries the
+	    // resource once, so an available resource doesn't suspend
+	    // the coroutine.
+
+	    template <typename Derived>
+	    class Awaitable : public WaitNode {
+	     protected:
+		explicit Awaitable(int const tmo) : WaitNode(tmo) {}
+
+	     public:
+		bool await_ready() NOTHROW
+		{
+		    return static_cast<Derived*>(this)->poll();
+		}
+
+		void await_suspend(std::coroutine_handle<Job::promise_type>
+				   const h) NOTHROW
+		{
+		    prepare(h);
+		    h.promise().sched->suspend(*this);
+		}
+	    };
+
+	    // Resumes the coroutine on the scheduler's next pass,
+	    // after the other runnable coroutines.
+
+	    class Yield : public Awaitable<Yield> {
+		bool once;
+
+	     public:
+		Yield() : Awaitable<Yield>(-1), once(false) {}
+
+		bool poll() NOTHROW
+		{
+		    bool const tmp = once;
+
+		    once = true;
+		    return tmp;
+		}
+
+		void await_resume() const NOTHROW {}
+	    };
+
+	    inline Yield yield() NOTHROW_IMPL { return Yield(); }
+
+	    // Suspends the coroutine for 'ms' milliseconds (rounded
+	    // up to clock ticks.)
+
+	    class Delay : public Awaitable<Delay> {
+	     public:
+		explicit Delay(int const ms) : Awaitable<Delay>(ms) {}
+
+		bool poll() NOTHROW { return false; }
+		void await_resume() const NOTHROW {}
+	    };
+
+	    inline Delay delay(int const ms) NOTHROW_IMPL { return Delay(ms); }
+
+	    // The awaitables for queues and events give Success, or
+	    // Timeout if 'tmo' milliseconds passed first (-1 waits
+	    // forever), or the error reported by the resource.
+
+	    template <typename T, size_t nn>
+	    class PopFront : public Awaitable<PopFront<T, nn> > {
+		Queue<T, nn>& q;
+		T& v;
+		Status result;
+
+	     public:
+		PopFront(Queue<T, nn>& qq, T& vv, int const tmo) :
+		    Awaitable<PopFront>(tmo), q(qq), v(vv), result(Timeout)
+		{}
+
+		bool poll() NOTHROW
+		{
+		    return !this->busy(result = q.try_pop_front(v, 0));
+		}
+
+		bool arm(uint32_t const bit) NOTHROW
+		{
+		    return Watch::start(q, bit);
+		}
+
+		void disarm() NOTHROW { Watch::stop(q); }
+		void const* resource() const NOTHROW { return Watch::key(q); }
+
+		Status await_resume() const NOTHROW
+		{
+		    return this->expired ? Timeout : result;
+		}
+	    };
+
+	    template <typename T, size_t nn>
+	    PopFront<T, nn> pop_front(Queue<T, nn>& q, T& v,
+				      int const tmo = -1) NOTHROW_IMPL
+	    {
+		return PopFront<T, nn>(q, v, tmo);
+	    }
+
+	    // A wakeAll() releases every coroutine waiting on the event
+	    // when it's called.
+
+	    template <typename E>
+	    class Wait : public Awaitable<Wait<E> > {
+		E& ev;
+		uint32_t flushes;
+		Status result;
+
+		Status check(Event<TaskSignal>& e) NOTHROW
+		{
+		    return e.try_wait(0);
+		}
+
+		Status check(Event<IntSignal>& e) NOTHROW
+		{
+		    IntLock lock;
+
+		    return e.try_wait(lock, 0);
+		}
+
+	     public:
+		Wait(E& e, int const tmo) :
+		    Awaitable<Wait>(tmo), ev(e), flushes(Watch::flushes(e)),
+		    result(Timeout)
+		{}
+
+		// The first coroutine to notice a wakeAll() takes the
+		// signal it left in the semaphore.
+
+		bool poll() NOTHROW
+		{
+		    if (Watch::flushes(ev) != flushes) {
+			check(ev);
+			result = Success;
+			return true;
+		    }
+		    return !this->busy(result = check(ev));
+		}
+
+		bool arm(uint32_t const bit) NOTHROW
+		{
+		    return Watch::start(ev, bit);
+		}
+
+		void disarm() NOTHROW { Watch::stop(ev); }
+		void const* resource() const NOTHROW { return Watch::key(ev); }
+
+		Status await_resume() const NOTHROW
+		{
+		    return this->expired ? Timeout : result;
+		}
+	    };
+
+	    template <typename T>
+	    Wait<Event<T> > wait(Event<T>& ev, int const tmo = -1) NOTHROW_IMPL
+	    {
+		return Wait<Event<T> >(ev, tmo);
+	    }
+
+	    // Holds a vwpp Mutex obtained by lock() (below) and
+	    // releases it when destroyed. Like Mutex::TryLock<>, it
+	    // records whether the mutex was obtained.
+
+	    class MutexLock : private Uncopyable {
+		v3_0::Mutex* m;
+		Status result;
+
+	     public:
+		MutexLock(v3_0::Mutex& mm, Status const s) NOTHROW :
+		    m(Success == s ? &mm : 0), result(s)
+		{}
+
+		MutexLock(MutexLock&& o) NOTHROW : m(o.m), result(o.result)
+		{
+		    o.m = 0;
+		}
+
+		~MutexLock() NOTHROW
+		{
+		    if (m)
+			Watch::release(*m);
+		}
+
+		Status status() const NOTHROW { return result; }
+		bool owns_lock() const NOTHROW { return m != 0; }
+	    };
+
+	    // Obtains a vwpp Mutex shared with other tasks. The mutex
+	    // is tried once a clock tick until it's free or 'tmo'
+	    // milliseconds pass.
+	    //
+	    //    MutexLock const lock = co_await coro::lock(dev.mtx, 100);
+	    //
+	    //    if (lock.owns_lock())
+	    //        dev.update();
+	    //
+	    // A vwpp Mutex belongs to the scheduler's task, not to a
+	    // coroutine, and it's recursive, so it can't keep the
+	    // coroutines of one scheduler apart. A coroutine must
+	    // release it before it suspends again.
+
+	    class LockMutex : public Awaitable<LockMutex> {
+		v3_0::Mutex& m;
+		Status result;
+
+	     public:
+		LockMutex(v3_0::Mutex& mm, int const tmo) :
+		    Awaitable<LockMutex>(tmo), m(mm), result(Timeout)
+		{}
+
+		bool poll() NOTHROW
+		{
+		    return !this->busy(result = Watch::try_acquire(m));
+		}
+
+		bool arm(uint32_t) NOTHROW { return false; }
+
+		MutexLock await_resume() const NOTHROW
+		{
+		    return MutexLock(m, this->expired ? Timeout : result);
+		}
+	    };
+
+	    inline LockMutex lock(v3_0::Mutex& m, int const tmo = -1)
+		NOTHROW_IMPL
+	    {
+		return LockMutex(m, tmo);
+	    }
+
+	    // coro::Mutex serializes the coroutines of one scheduler,
+	    // which a vwpp Mutex can't do. They may hold it across
+	    // suspension points:
+	    //
+	    //    coro::Mutex::Lock lock = co_await mtx.lock();
+
+	    class Mutex : private Uncopyable {
+		bool held;
+
+	     public:
+		class Lock : private Uncopyable {
+		    Mutex* m;
+
+		 public:
+		    explicit Lock(Mutex& mm) NOTHROW : m(&mm) {}
+		    Lock(Lock&& o) NOTHROW : m(o.m) { o.m = 0; }
+		    ~Lock() NOTHROW { if (m) m->held = false; }
+		};
+
+		class Acquire : public Awaitable<Acquire> {
+		    Mutex& m;
+
+		 public:
+		    explicit Acquire(Mutex& mm) :
+			Awaitable<Acquire>(-1), m(mm)
+		    {}
+
+		    bool poll() NOTHROW
+		    {
+			if (m.held)
+			    return false;
+			m.held = true;
+			return true;
+		    }
+
+		    Lock await_resume() NOTHROW { return Lock(m); }
+		};
+
+		Mutex() : held(false) {}
+
+		Acquire lock() NOTHROW { return Acquire(*this); }
+	    };
+	};
+    };
+};
+
+#endif
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
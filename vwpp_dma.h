@@ -0,0 +1,214 @@
+#if !defined(__VWPP_DMA_H)
+#define __VWPP_DMA_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	namespace VME {
+
+	    enum DmaDirection { FromVme, ToVme };
+
+	    // One piece of a scatter/gather transfer: 'bytes' bytes
+	    // are copied between VME address 'addr' and the local
+	    // buffer 'local'.
+
+	    struct DmaSegment {
+		AddressSpace space;
+		uint32_t addr;
+		void* local;
+		size_t bytes;
+		DmaDirection dir;
+	    };
+
+	    class Dma;
+	    class DmaEngine;
+
+	    // A DmaRequest describes a transfer and is the handle used
+	    // to wait for it. The owner keeps the request, and its
+	    // segment list, alive until the transfer completes. A
+	    // request can be submitted again once it's finished.
+
+	    class DmaRequest : private Uncopyable, private NoHeap {
+		friend class Dma;
+		friend class DmaEngine;
+
+		enum State { Idle, Queued, Active };
+
+		DmaSegment const* segs;
+		size_t nSegs;
+		Dma* owner;
+		DmaRequest* next;
+		Atomic<State> state;
+		Status result;
+		Event<IntSignal> done;
+
+	     public:
+		DmaRequest() :
+		    segs(0), nSegs(0), owner(0), next(0), state(Idle),
+		    result(Success)
+		{}
+
+		DmaRequest(DmaSegment const* const s, size_t const n) :
+		    segs(s), nSegs(n), owner(0), next(0), state(Idle),
+		    result(Success)
+		{}
+
+		// Changes the segment list. Throws std::logic_error if
+		// the request is queued or in progress.
+
+		void setSegments(DmaSegment const*, size_t);
+
+		DmaSegment const* segments() const NOTHROW { return segs; }
+		size_t segmentCount() const NOTHROW { return nSegs; }
+
+		bool isBusy() const NOTHROW
+		{
+		    return Idle != state.load(Acquire);
+		}
+
+		// Waits for the transfer to finish. wait() returns
+		// false if the timeout expired and throws
+		// std::runtime_error if the engine reported an error.
+		// try_wait() returns Timeout, or the engine's result.
+		// Waiting on a request that was never submitted
+		// returns right away.
+
+		bool wait(int = -1);
+		Status try_wait(int = -1) NOTHROW;
+	    };
+
+	    // DmaEngine is the interface to a DMA controller. Dma calls
+	    // start() for at most depth() requests at a time; the
+	    // engine reports each one with complete(), usually from
+	    // its interrupt handler. start() is called with interrupts
+	    // locked, possibly at interrupt level, so it should only
+	    // program the controller (or queue the request) and
+	    // return.
+
+	    class DmaEngine : private Uncopyable, private NoHeap {
+	     protected:
+		DmaEngine() {}
+
+		static void complete(DmaRequest&, Status) NOTHROW;
+
+	     public:
+		virtual ~DmaEngine() NOTHROW {}
+
+		virtual size_t depth() const NOTHROW = 0;
+		virtual void start(DmaRequest&) NOTHROW = 0;
+	    };
+
+	    // Dma queues requests for an engine. Requests beyond the
+	    // engine's depth wait in FIFO order and are started as
+	    // earlier ones complete, so the caller can have several
+	    // transfers outstanding while it processes data.
+	    //
+	    //    DmaSegment seg = { A32, 0x08000000, buf, sizeof(buf),
+	    //                       FromVme };
+	    //    DmaRequest req(&seg, 1);
+	    //
+	    //    dma.submit(req);
+	    //    ...
+	    //    req.wait();
+	    //
+	    // The Dma object must outlive the requests submitted to it.
+
+	    class Dma : private Uncopyable, private NoHeap {
+		friend class DmaEngine;
+
+		DmaEngine& engine;
+		size_t inFlight;
+		DmaRequest* head;
+		DmaRequest* tail;
+
+		void finished(DmaRequest&, Status) NOTHROW;
+
+	     public:
+		explicit Dma(DmaEngine& e) :
+		    engine(e), inFlight(0), head(0), tail(0)
+		{}
+
+		// Queues a request. The throwing version raises
+		// std::logic_error if the request is still busy and
+		// std::invalid_argument if it has no segments. The
+		// non-throwing version returns Unavailable or
+		// BadLength, respectively.
+
+		void submit(DmaRequest&);
+		Status try_submit(DmaRequest&) NOTHROW;
+
+		// Returns the number of requests queued or in
+		// progress.
+
+		size_t outstanding() const NOTHROW;
+	    };
+
+	    // SoftDmaEngine copies with the CPU, in a task of its own.
+	    // It's meant for boards without a DMA controller and for
+	    // exercising drivers; it doesn't save CPU time, but the
+	    // copy runs at the task's priority rather than the
+	    // caller's. VME addresses are mapped with calcBaseAddr();
+	    // override translate() to redirect them (e.g. to a local
+	    // buffer standing in for a device.) Aligned segments are
+	    // copied in 32-bit words, others a byte at a time.
+
+	    class SoftDmaEngine : public DmaEngine {
+		class Worker;
+		friend class Worker;
+
+		class Worker : public Task {
+		    SoftDmaEngine& engine;
+
+		    void taskEntry();
+
+		 public:
+		    explicit Worker(SoftDmaEngine& e) : engine(e) {}
+		    ~Worker() NOTHROW { kill(); }
+
+		    void stop() NOTHROW { kill(); }
+		};
+
+	     public:
+		enum { MaxDepth = 8 };
+
+	     private:
+		size_t const maxDepth;
+		DmaRequest* ring[MaxDepth];
+		size_t first;
+		size_t count;
+		Event<IntSignal> work;
+		Worker worker;
+
+		Status copy(DmaRequest const&);
+
+	     protected:
+		virtual uint8_t volatile* translate(AddressSpace, uint32_t);
+
+	     public:
+		explicit SoftDmaEngine(size_t = 2);
+		~SoftDmaEngine() NOTHROW;
+
+		// Spawns the copying task. This must be called before
+		// requests are submitted.
+
+		void run(char const* = "tVwppDma", unsigned char = 200,
+			 int = 8192);
+
+		size_t depth() const NOTHROW { return maxDepth; }
+		void start(DmaRequest&) NOTHROW;
+	    };
+	};
+    };
+};
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
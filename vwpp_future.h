@@ -0,0 +1,231 @@
+#if !defined(__VWPP_FUTURE_H)
+#define __VWPP_FUTURE_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	template <typename T> class Future;
+
+	// PromiseBase holds the state shared by a Promise and its
+	// Futures. The state lives in the Promise, which the owner
+	// allocates up front (e.g. as part of a device's request
+	// block), so no memory gets allocated per request.
+
+	class PromiseBase : private Uncopyable, private NoHeap {
+	    enum { Empty, Armed, Setting, Ready };
+
+	    Atomic<uint32_t> state;
+	    Status result;
+	    Event<IntSignal> ev;
+
+	 protected:
+	    PromiseBase() : state(Empty), result(Success) {}
+
+	    void arm();
+	    bool claim() NOTHROW;
+	    void publish(Status) NOTHROW;
+
+	 public:
+	    bool isReady() const NOTHROW
+	    {
+		return Ready == state.load(Acquire);
+	    }
+
+	    Status try_wait(int = -1) NOTHROW;
+
+	    // Waits until any promise is fulfilled. when_any() uses
+	    // this and then checks its own futures. Returns Timeout,
+	    // even for a timeout of 0, if none was.
+
+	    static Status waitAny(IntLock&, int) NOTHROW;
+	};
+
+	// A Promise<> is fulfilled once per request. get_future()
+	// arms it and returns the handle the requester waits on; the
+	// responder then calls set_value() or set_failure(), which
+	// may be done from an interrupt handler. Once the value has
+	// been consumed, get_future() can arm the promise again. T
+	// must be default-constructible and assignable; since
+	// set_value() may run at interrupt level, its assignment
+	// shouldn't do more than copy data.
+	//
+	//    Promise<uint32_t> reply;
+	//
+	//    Future<uint32_t> f = reply.get_future();
+	//
+	//    cmdQ.push_back(Request(READ_STATUS, &reply));
+	//    uint32_t const status = f.get(100);
+
+	template <typename T>
+	class Promise : public PromiseBase {
+	    friend class Future<T>;
+
+	    T value;
+
+	 public:
+	    Promise() {}
+
+	    // Throws std::logic_error if the previous request hasn't
+	    // been fulfilled.
+
+	    Future<T> get_future()
+	    {
+		arm();
+		return Future<T>(*this);
+	    }
+
+	    // These return false if the promise isn't armed or was
+	    // already fulfilled.
+
+	    bool set_value(T const& v) NOTHROW
+	    {
+		if (!claim())
+		    return false;
+		value = v;
+		publish(Success);
+		return true;
+	    }
+
+	    bool set_failure() NOTHROW
+	    {
+		if (!claim())
+		    return false;
+		publish(Failure);
+		return true;
+	    }
+	};
+
+	// A Future<> refers to its Promise, so it must not outlive
+	// it. A default-constructed Future isn't associated with a
+	// promise; waiting on it returns BadHandle. try_wait() and
+	// try_get() return Failure if the responder reported one and
+	// Timeout if the promise wasn't fulfilled in time (including
+	// when polling with a timeout of 0.)
+
+	template <typename T>
+	class Future : private NoHeap {
+	    friend class Promise<T>;
+
+	    Promise<T>* p;
+
+	    explicit Future(Promise<T>& pr) : p(&pr) {}
+
+	 public:
+	    Future() : p(0) {}
+
+	    bool valid() const NOTHROW { return p != 0; }
+	    bool isReady() const NOTHROW { return p && p->isReady(); }
+
+	    Status try_wait(int const tmo = -1) const NOTHROW
+	    {
+		return p ? p->try_wait(tmo) : BadHandle;
+	    }
+
+	    // Returns true once the promise is fulfilled (or has
+	    // failed) and false if the timeout expired.
+
+	    bool wait(int const tmo = -1) const
+	    {
+		switch (try_wait(tmo)) {
+		 case Success:
+		 case Failure:
+		    return true;
+
+		 case Timeout:
+		    return false;
+
+		 default:
+		    VWPP_THROW(std::logic_error("can't wait on future"));
+		}
+	    }
+
+	    Status try_get(T& v, int const tmo = -1) const NOTHROW
+	    {
+		Status const s = try_wait(tmo);
+
+		if (Success == s)
+		    v = p->value;
+		return s;
+	    }
+
+	    // Throws timeout_error if the timeout expires and
+	    // std::runtime_error if the request failed.
+
+	    T get(int const tmo = -1) const
+	    {
+		T v;
+
+		switch (try_get(v, tmo)) {
+		 case Success:
+		    return v;
+
+		 case Timeout:
+		    VWPP_THROW(timeout_error("timeout waiting on future"));
+
+		 case Failure:
+		    VWPP_THROW(std::runtime_error("request failed"));
+
+		 default:
+		    VWPP_THROW(std::logic_error("can't wait on future"));
+		}
+	    }
+	};
+
+	// Waits until all 'n' futures are ready, or the timeout
+	// expires. Returns Success or Timeout; the futures have to
+	// be checked individually for failures. A task can issue
+	// requests to many devices and then wait once.
+
+	template <typename T>
+	Status when_all(Future<T> const* const f, size_t const n,
+			int const tmo = -1) NOTHROW_IMPL
+	{
+	    Deadline const dl(tmo);
+
+	    for (size_t ii = 0; ii < n; ++ii) {
+		Status const s = f[ii].try_wait(dl.remaining());
+
+		if (Success != s && Failure != s)
+		    return s;
+	    }
+	    return Success;
+	}
+
+	// Waits until one of the 'n' futures is ready, or the
+	// timeout expires. On Success, 'idx' holds the index of the
+	// ready future (the lowest one, if several are ready.)
+
+	template <typename T>
+	Status when_any(Future<T> const* const f, size_t const n,
+			size_t& idx, int const tmo = -1) NOTHROW_IMPL
+	{
+	    Deadline const dl(tmo);
+	    IntLock lock;
+
+	    while (true) {
+		for (size_t ii = 0; ii < n; ++ii)
+		    if (f[ii].isReady()) {
+			idx = ii;
+			return Success;
+		    }
+
+		Status const s = PromiseBase::waitAny(lock, dl.remaining());
+
+		if (Success != s)
+		    return s;
+	    }
+	}
+    };
+};
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
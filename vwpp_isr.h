@@ -0,0 +1,100 @@
+#if !defined(__VWPP_ISR_H)
+#define __VWPP_ISR_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// Statistics of an interrupt handler. Times are given in
+	// microseconds.
+
+	struct IsrStats {
+	    uint32_t count;		// times the handler ran
+	    uint64_t totalTime;		// total time spent in the handler
+	    uint32_t maxTime;		// longest time spent in the handler
+	};
+
+	// InterruptBase connects a handler to an interrupt vector.
+	// VxWorks can't disconnect an interrupt so each vector gets
+	// connected, once, to a trampoline which looks up the current
+	// handler in a table. Destroying the object clears the table
+	// entry; interrupts arriving on the vector after that are
+	// ignored (but still acknowledged by the BSP's interrupt
+	// controller code.) Only one handler may be attached to a
+	// vector at a time.
+	//
+	// If 'stats' is true, the trampoline counts invocations and
+	// measures the time spent in the handler, using the time
+	// base. This adds a few dozen cycles to each interrupt.
+
+	class InterruptBase : private Uncopyable, private NoHeap {
+	    int const vector;
+
+	 public:
+	    typedef void (*Dispatch)(void*);
+
+	    enum { MaxVectors = 256 };
+
+	 protected:
+	    InterruptBase(int, Dispatch, void*, bool);
+	    ~InterruptBase() NOTHROW;
+
+	 public:
+
+	    int getVector() const NOTHROW { return vector; }
+
+	    // Returns the statistics gathered since the handler was
+	    // attached, or since the last reset. These must be called
+	    // by a task.
+
+	    IsrStats stats() const;
+	    void resetStats() NOTHROW;
+
+	    // Prints the statistics of every handler which keeps them.
+
+	    static void show();
+	};
+
+	// Interrupt<> calls a member function of an object when the
+	// interrupt arrives. The member function runs at interrupt
+	// level, so it can only use the ISR-safe parts of vwpp (e.g.
+	// Event<IntSignal>::wakeOne(), BlockPool, non-blocking queue
+	// operations.)
+	//
+	//    class Driver {
+	//        void isr();
+	//        Interrupt<Driver, &Driver::isr> irq;
+	//
+	//     public:
+	//        Driver(int vec) : irq(vec, *this) {}
+	//    };
+
+	template <class T, void (T::*Handler)()>
+	class Interrupt : public InterruptBase {
+	    static void dispatch(void* const obj)
+	    {
+		(static_cast<T*>(obj)->*Handler)();
+	    }
+
+	 public:
+	    Interrupt(int const vec, T& obj, bool const stats = false) :
+		InterruptBase(vec, &dispatch, &obj, stats)
+	    {}
+	};
+    };
+};
+
+extern "C" {
+    STATUS vwppIsrShow();
+}
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
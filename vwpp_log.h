@@ -0,0 +1,87 @@
+#if !defined(__VWPP_LOG_H)
+#define __VWPP_LOG_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+// Messages below this severity are removed at compile time. Define it
+// on the compiler's command line to change it for a module.
+
+#if !defined(VWPP_LOG_THRESHOLD)
+#define VWPP_LOG_THRESHOLD	vwpp::v3_0::LogInfo
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	enum LogLevel { LogDebug, LogInfo, LogWarning, LogError };
+
+	// The Log class is a replacement for logMsg() which is cheap
+	// enough to use in time-critical code and interrupt handlers.
+	// Logging a message only stores a time stamp, the address of
+	// the format string and up to six integer arguments in a
+	// lock-free ring buffer (one per CPU.) A low priority task
+	// formats the records later.
+	//
+	// As with logMsg(), the format string, and any strings passed
+	// as arguments, must still exist when the record gets
+	// formatted -- string literals are the safe choice. If a ring
+	// fills up, new records are dropped; the next record that
+	// fits reports how many were lost.
+
+	class Log : private Uncopyable {
+	    Log();
+
+	 public:
+	    enum { RingSize = 256, MaxArgs = 6 };
+
+	    static void record(LogLevel, char const*, int, int, int, int,
+			       int, int) NOTHROW;
+
+	    // Starts the task which formats records. They are written
+	    // to the file descriptor 'fd' every 'period' milliseconds.
+
+	    static void start(int fd = 2, int period = 100,
+			      unsigned char pri = 240);
+	    static void stop() NOTHROW;
+
+	    // Formats the pending records right away. This must be
+	    // called by a task.
+
+	    static void flush();
+
+	    // Returns the number of records dropped since the system
+	    // started.
+
+	    static uint32_t dropped() NOTHROW;
+	};
+
+	// Logs a message with severity 'L'. When 'L' is below
+	// VWPP_LOG_THRESHOLD, the call compiles to nothing.
+	//
+	//    log_msg<LogWarning>("bad status 0x%x on channel %d", st, ch);
+
+	template <LogLevel L>
+	inline void log_msg(char const* const fmt, int const a1 = 0,
+			    int const a2 = 0, int const a3 = 0,
+			    int const a4 = 0, int const a5 = 0,
+			    int const a6 = 0) NOTHROW_IMPL
+	{
+	    if (L >= VWPP_LOG_THRESHOLD)
+		Log::record(L, fmt, a1, a2, a3, a4, a5, a6);
+	}
+    };
+};
+
+extern "C" {
+    STATUS vwppLogStart(int);
+}
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
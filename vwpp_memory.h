@@ -24,15 +24,18 @@ namespace vwpp {
 	    template <typename T, size_t Offset, enum ReadAccess = NoRead>
 	    struct ReadAPI { };
 
-	    // Reads a value from "volatile" memory. We prevent the
-	    // compiler from optimizing around this call.
+	    // Reads a value from "volatile" memory. Earlier accesses
+	    // to the device have to complete first (a status read
+	    // often follows the write which started an operation) so
+	    // this needs I/O ordering. We prevent the compiler from
+	    // optimizing around this call.
 
 	    template <typename T, size_t Offset>
 	    struct ReadAPI<T, Offset, Read> {
 		static T readMem(uint8_t volatile* const base,
 				 size_t const idx) NOTHROW_IMPL
 		{
-		    memory_sync();
+		    io_fence();
 
 		    T const val =
 			*(reinterpret_cast<T volatile*>(base + Offset) + idx);
@@ -40,8 +43,22 @@ namespace vwpp {
 		    optimizer_barrier();
 		    return val;
 		}
+
+		// Reads the value without ordering it. This is used
+		// when several registers are read in one pass, after a
+		// single fence.
+
+		static T readRaw(uint8_t volatile* const base,
+				 size_t const idx) NOTHROW_IMPL
+		{
+		    return *(reinterpret_cast<T volatile*>(base + Offset) + idx);
+		}
 	    };
 
+	    // A read with side effects (e.g. popping a FIFO) mustn't
+	    // be performed speculatively, so the processor has to
+	    // finish everything before it.
+
 	    template <typename T, size_t Offset>
 	    struct ReadAPI<T, Offset, DestructiveRead> {
 		static T readMem(uint8_t volatile* const base,
@@ -57,7 +74,11 @@ namespace vwpp {
 		}
 	    };
 
-	    // This section declare a small API to write to memory.
+	    // This section declare a small API to write to memory. A
+	    // write has to follow earlier reads, as well as writes, of
+	    // the device, so it also uses I/O ordering. A confirmed
+	    // write reads the register back, which doesn't complete
+	    // until the write has reached the device.
 
 	    enum WriteAccess { NoWrite, Write, ConfirmWrite };
 
@@ -69,7 +90,7 @@ namespace vwpp {
 		static void writeMem(uint8_t volatile* const base,
 				     size_t const idx, T const& v) NOTHROW_IMPL
 		{
-		    memory_sync();
+		    io_fence();
 		    *(reinterpret_cast<T volatile*>(base + Offset) + idx) = v;
 		    optimizer_barrier();
 		}
@@ -83,9 +104,9 @@ namespace vwpp {
 		    T volatile* const ptr =
 			reinterpret_cast<T volatile*>(base + Offset) + idx;
 
-		    memory_sync();
+		    io_fence();
 		    *ptr = v;
-		    memory_sync();
+		    io_fence();
 		    *ptr;
 		}
 	    };
@@ -103,7 +124,7 @@ namespace vwpp {
 		    T volatile* const ptr =
 			reinterpret_cast<T volatile*>(base + Offset) + idx;
 
-		    memory_sync();
+		    io_fence();
 		    *ptr = (*ptr & ~mask) | (v & mask);
 		    optimizer_barrier();
 		}
@@ -118,9 +139,9 @@ namespace vwpp {
 		    T volatile* const ptr =
 			reinterpret_cast<T volatile*>(base + Offset) + idx;
 
-		    memory_sync();
+		    io_fence();
 		    *ptr = (*ptr & ~mask) | (v & mask);
-		    memory_sync();
+		    io_fence();
 		    *ptr;
 		}
 	    };
@@ -139,6 +160,11 @@ namespace vwpp {
 		    return ReadAPI<Type, Offset, R>::readMem(base, 0);
 		}
 
+		static Type readRaw(uint8_t volatile* const base) NOTHROW_IMPL
+		{
+		    return ReadAPI<Type, Offset, R>::readRaw(base, 0);
+		}
+
 		static void write(uint8_t volatile* const base, Type const& v) NOTHROW_IMPL
 		{
 		    WriteAPI<Type, Offset, W>::writeMem(base, 0, v);
@@ -181,10 +207,182 @@ namespace vwpp {
 		}
 	    };
 
+	    // Register64Split<> reads a 64-bit value (a time stamp or
+	    // an event counter) which the hardware presents as two
+	    // 32-bit registers. Reading the halves separately can tear
+	    // when the low word wraps between the reads, so the high
+	    // word is read before and after the low word; if it
+	    // changed, the low word is read again. The halves don't
+	    // have to be adjacent, but they have to be in the same
+	    // address space. It's used like any other read-only
+	    // register:
+	    //
+	    //    typedef Register<A24, uint32_t, 0x20, Read, NoWrite> TsHi;
+	    //    typedef Register<A24, uint32_t, 0x24, Read, NoWrite> TsLo;
+	    //    typedef Register64Split<TsHi, TsLo> Timestamp;
+	    //
+	    //    uint64_t const ts = mem.get<Timestamp>(lock);
+	    //
+	    // Only the first read is fenced. The VME windows are mapped
+	    // caching-inhibited and guarded, so the processor performs
+	    // the following reads in program order.
+
+	    template <typename Hi, typename Lo>
+	    struct Register64Split {
+		typedef uint64_t Type;
+		typedef uint32_t AtomicType;
+
+		static AddressSpace const space = Hi::space;
+
+		enum {
+		    First = Hi::RegOffset < Lo::RegOffset ?
+			Hi::RegOffset : Lo::RegOffset,
+		    Last = Hi::RegOffset < Lo::RegOffset ?
+			Lo::RegOffset : Hi::RegOffset,
+		    RegOffset = First,
+		    RegEntries = (Last - First) / 4 + 1
+		};
+
+	     private:
+		template <bool, int = 0> struct Valid { };
+		template <int Dummy> struct Valid<true, Dummy> {
+		    typedef Valid type;
+		};
+
+		typedef typename Valid<(Hi::space == Lo::space &&
+					sizeof(typename Hi::Type) == 4 &&
+					sizeof(typename Lo::Type) == 4 &&
+					(Last - First) % 4 == 0 &&
+					Last != First)>::type Check;
+
+	     public:
+		static Type read(uint8_t volatile* const base) NOTHROW_IMPL
+		{
+		    io_fence();
+
+		    uint32_t hi = Hi::readRaw(base);
+		    uint32_t lo;
+
+		    while (true) {
+			optimizer_barrier();
+			lo = Lo::readRaw(base);
+			optimizer_barrier();
+
+			uint32_t const tmp = Hi::readRaw(base);
+
+			if (LIKELY(tmp == hi))
+			    break;
+			hi = tmp;
+		    }
+		    optimizer_barrier();
+		    return (static_cast<uint64_t>(hi) << 32) | lo;
+		}
+	    };
+
+	    // These templates describe a bank of registers which
+	    // Memory::snapshot() copies into a plain structure. Each
+	    // Field<> binds a (non-array, non-destructive) register to
+	    // a member of the structure. RegList<> holds up to eight
+	    // fields, which have to be listed in increasing offset
+	    // order (this is checked at compile-time.)
+	    //
+	    //    struct Status { uint32_t csr; uint16_t fill; };
+	    //
+	    //    typedef RegList<Field<Csr, Status, &Status::csr>,
+	    //                    Field<Fill, Status, &Status::fill> > Bank;
+	    //
+	    //    Status st;
+	    //
+	    //    mem.snapshot<Bank>(lock, st);
+
+	    template <typename R, typename S, typename R::Type S::*Member>
+	    struct Field {
+		typedef R Reg;
+		typedef S Struct;
+
+		static size_t const Offset = R::RegOffset;
+		static size_t const End =
+		    R::RegOffset + sizeof(typename R::Type);
+
+		static void read(uint8_t volatile* const base,
+				 S& s) NOTHROW_IMPL
+		{
+		    s.*Member = R::readRaw(base);
+		}
+	    };
+
+	    struct NoField {
+		typedef void Struct;
+
+		static size_t const Offset = ~static_cast<size_t>(0);
+	    };
+
+	    template <typename F1, typename F2 = NoField,
+		      typename F3 = NoField, typename F4 = NoField,
+		      typename F5 = NoField, typename F6 = NoField,
+		      typename F7 = NoField, typename F8 = NoField>
+	    struct RegList {
+		typedef F1 Head;
+		typedef RegList<F2, F3, F4, F5, F6, F7, F8> Tail;
+		typedef typename F1::Struct Struct;
+
+	     private:
+		template <bool, int = 0> struct Valid { };
+		template <int Dummy> struct Valid<true, Dummy> {
+		    typedef Valid type;
+		};
+
+		template <typename A, typename B> struct Same {
+		    enum { value = false };
+		};
+		template <typename A> struct Same<A, A> {
+		    enum { value = true };
+		};
+
+		typedef typename Valid<(F1::End <= F2::Offset &&
+					(Same<Struct,
+					 typename F2::Struct>::value ||
+					 Same<void,
+					 typename F2::Struct>::value))>::type
+		Check;
+	    };
+
+	    // The empty list ends the recursion in Memory::snapshot().
+
+	    template <>
+	    struct RegList<NoField> { };
+
 	    enum DataAccess {
 		D8 = 1, D16, D8_D16, D32, D8_D32, D16_D32, D8_D16_D32
 	    };
 
+	    // Paces the polling loop of Memory::wait_until(). For the
+	    // first 'SpinUs' microseconds, next() returns right away
+	    // so the register gets read as fast as the bus allows.
+	    // Until 'BackoffUs' microseconds have passed, next() busy
+	    // waits between reads, doubling the pause each time (up
+	    // to 'MaxPauseUs') to cut down on bus traffic. After
+	    // that, it sleeps a clock tick per read. next() returns
+	    // false once the timeout, in milliseconds, has expired.
+	    // This can't be used by interrupt handlers.
+
+	    class Poller : private Uncopyable, private NoHeap {
+		uint32_t const start;
+		uint32_t const perUs;
+		uint32_t const limitUs;
+		int const tmo;
+		uint32_t pause;
+		uint32_t tickStart;
+		bool sleeping;
+
+	     public:
+		enum { SpinUs = 20, BackoffUs = 500, MaxPauseUs = 64 };
+
+		explicit Poller(int);
+
+		bool next();
+	    };
+
 	    // This is the generalized template of a class that
 	    // controls access to VME memory space. It is given as a
 	    // forward declaration and gets defined later in the
@@ -231,6 +429,24 @@ namespace vwpp {
 		    return reinterpret_cast<T volatile*>(baseAddr + offset);
 		}
 
+		template <typename L>
+		void readFields(typename L::Struct& s, L*) const NOTHROW_IMPL
+		{
+		    typedef typename L::Head::Reg R;
+		    typedef typename Accessible<R::space,
+						typename R::AtomicType,
+						R::RegEntries,
+						R::RegOffset>::allowed type;
+
+		    L::Head::read(baseAddr, s);
+		    optimizer_barrier();
+		    readFields(s, static_cast<typename L::Tail*>(0));
+		}
+
+		template <typename S>
+		void readFields(S&, RegList<NoField>*) const NOTHROW_IMPL
+		{}
+
 	     protected:
 		Memory(Memory const& o) : baseAddr(o.baseAddr) {}
 
@@ -260,7 +476,7 @@ namespace vwpp {
 		    if (type::in_range(idx))
 			return R::read(baseAddr, idx);
 		    else
-			throw std::runtime_error("index out of range");
+			VWPP_THROW(std::runtime_error("index out of range"));
 		}
 
 		template <typename R>
@@ -286,7 +502,7 @@ namespace vwpp {
 		    if (type::in_range(idx))
 			R::write(baseAddr, idx, v);
 		    else
-			throw std::runtime_error("index out of range");
+			VWPP_THROW(std::runtime_error("index out of range"));
 		}
 
 		template <typename R>
@@ -301,6 +517,48 @@ namespace vwpp {
 		    R::writeField(baseAddr, mask, v);
 		}
 
+		// Polls a register until the bits selected by 'mask'
+		// equal 'value' or until 'tmo' milliseconds have passed
+		// (-1 waits forever.) The last value read is stored in
+		// 'result'. Returns Success or Timeout; it never
+		// throws. Polling starts with a short busy spin, since
+		// most hardware completes within a few microseconds,
+		// and slows down from there (see Poller.)
+
+		template <typename R>
+		Status wait_until(typename R::Type const& mask,
+				  typename R::Type const& value, int const tmo,
+				  typename R::Type& result) const
+		{
+		    typedef typename Accessible<R::space,
+						typename R::AtomicType,
+						R::RegEntries,
+						R::RegOffset>::allowed type;
+
+		    if (((result = R::read(baseAddr)) & mask) == value)
+			return Success;
+
+		    Poller poller(tmo);
+
+		    while (poller.next())
+			if (((result = R::read(baseAddr)) & mask) == value)
+			    return Success;
+		    return Timeout;
+		}
+
+		// Copies the registers of RegList 'L' into 's'. The
+		// registers are read in offset order with one fence
+		// before the first read, rather than one per register.
+		// This doesn't make the copy atomic -- the device can
+		// still change between the reads.
+
+		template <typename L>
+		void snapshot(typename L::Struct& s) const NOTHROW_IMPL
+		{
+		    io_fence();
+		    readFields(s, static_cast<L*>(0));
+		}
+
 		template <typename T>
 		T unsafe_get(size_t const offset) const NOTHROW_IMPL
 		{
@@ -372,6 +630,31 @@ namespace vwpp {
 			       typename R::Type const& v) const NOTHROW_IMPL
 		{ Base::template set_field<R>(mask, v); }
 
+		template <typename R>
+		Status wait_until(Lock const&, typename R::Type const& mask,
+				  typename R::Type const& value, int const tmo,
+				  typename R::Type& result) const
+		{
+		    return Base::template wait_until<R>(mask, value, tmo,
+							result);
+		}
+
+		template <typename R>
+		Status wait_until(Lock const& lock,
+				  typename R::Type const& mask,
+				  typename R::Type const& value,
+				  int const tmo) const
+		{
+		    typename R::Type result;
+
+		    return wait_until<R>(lock, mask, value, tmo, result);
+		}
+
+		template <typename L>
+		void snapshot(Lock const&,
+			      typename L::Struct& s) const NOTHROW_IMPL
+		{ Base::template snapshot<L>(s); }
+
 		template <typename T>
 		T unsafe_get(Lock const&, size_t const offset) const NOTHROW_IMPL
 		{ return Base::template unsafe_get<T>(offset); }
@@ -0,0 +1,75 @@
+#if !defined(__VWPP_MONITOR_H)
+#define __VWPP_MONITOR_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// This structure holds the statistics gathered for a task.
+	// CPU shares are given in tenths of a percent and are
+	// computed from the number of clock ticks that interrupted
+	// the task.
+
+	struct TaskUsage {
+	    int id;
+	    char const* name;
+
+	    unsigned cpuLast;		// CPU share in the last window
+	    unsigned cpuAverage;	// CPU share over all windows
+	    uint32_t switchesLast;	// times switched in, last window
+	    uint32_t switchesTotal;	// times switched in, all windows
+
+	    size_t stackSize;
+	    size_t stackHigh;		// most stack ever used
+	    size_t stackMargin;		// stackSize - stackHigh
+	};
+
+	// The TaskMonitor samples every task created through the Task
+	// class. A tick hook charges each system clock tick to the
+	// interrupted task and a task switch hook counts how often
+	// each task gets the CPU. A low priority task closes a window
+	// every 'period' milliseconds, keeping the last 'Windows'
+	// windows, and refreshes the stack high-water marks.
+	//
+	// Tasks are tracked in a fixed-size table. If more than
+	// 'MaxTasks' vwpp tasks exist, the extra ones aren't
+	// monitored. Stack high-water marks are only available for
+	// tasks spawned with stack filling enabled (the default.)
+
+	class TaskMonitor : private Uncopyable {
+	    friend class Task;
+
+	    static void attach(int) NOTHROW;
+	    static void detach(int) NOTHROW;
+
+	    TaskMonitor();
+
+	 public:
+	    enum { MaxTasks = 64, Windows = 8 };
+
+	    static void start(int period = 1000, unsigned char pri = 250);
+	    static void stop() NOTHROW;
+
+	    static bool query(Task const&, TaskUsage&);
+	    static size_t query(TaskUsage*, size_t);
+
+	    static void show();
+	};
+    };
+};
+
+extern "C" {
+    STATUS vwppTaskMonitorStart(int);
+    STATUS vwppTaskMonitorShow();
+}
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
@@ -0,0 +1,241 @@
+#if !defined(__VWPP_POOL_H)
+#define __VWPP_POOL_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// BlockPoolBase implements a pool of fixed-size blocks. The
+	// free blocks form a linked list whose head is updated with a
+	// compare-and-swap, so allocating and freeing a block is O(1),
+	// never blocks and may be done by interrupt handlers. The
+	// head holds the index of the first free block in its lower
+	// 16 bits and a generation count in the upper 16 bits; the
+	// count changes on every update so a stale compare-and-swap
+	// can't succeed (the "ABA" problem.)
+
+	class BlockPoolBase : private Uncopyable, private NoHeap {
+	    enum { Nil = 0xffff };
+
+	    Atomic<uint32_t> head;
+	    Atomic<uint32_t> used;
+	    Atomic<uint32_t> highWater;
+	    uint16_t* next;
+	    uint8_t* storage;
+	    size_t size;
+	    size_t count;
+
+	 protected:
+	    BlockPoolBase() : head(Nil), next(0), storage(0), size(0), count(0)
+	    {}
+
+	    // Called by the constructor of the derived class to hand
+	    // over its storage.
+
+	    void _init(uint16_t* const n, void* const buf, size_t const sz,
+		       size_t const nn) NOTHROW
+	    {
+		next = n;
+		storage = reinterpret_cast<uint8_t*>(buf);
+		size = sz;
+		count = nn;
+		for (size_t ii = 0; ii < nn; ++ii)
+		    next[ii] = ii + 1 < nn ? ii + 1 : Nil;
+		head.store(nn ? 0 : Nil, Release);
+	    }
+
+	 public:
+	    // Returns a free block or 0, if the pool is exhausted.
+
+	    void* allocate() NOTHROW
+	    {
+		uint32_t old = head.load(Acquire);
+		uint32_t idx;
+
+		do {
+		    idx = old & 0xffff;
+		    if (UNLIKELY(Nil == idx))
+			return 0;
+		} while (!head.compare_exchange(old, (old & 0xffff0000) +
+						0x10000 + next[idx],
+						Acquire));
+
+		uint32_t const inUse = used.fetch_add(1, Relaxed) + 1;
+		uint32_t hw = highWater.load(Relaxed);
+
+		while (inUse > hw &&
+		       !highWater.compare_exchange(hw, inUse, Relaxed))
+		    ;
+		return storage + idx * size;
+	    }
+
+	    // Returns a block to the pool. Pointers that don't belong
+	    // to the pool are ignored.
+
+	    void deallocate(void* const ptr) NOTHROW
+	    {
+		size_t const offset = reinterpret_cast<uint8_t*>(ptr) - storage;
+
+		if (UNLIKELY(!ptr || offset >= size * count ||
+			     offset % size != 0))
+		    return;
+
+		uint32_t const idx = offset / size;
+		uint32_t old = head.load(Relaxed);
+
+		do
+		    next[idx] = old & 0xffff;
+		while (!head.compare_exchange(old, (old & 0xffff0000) +
+					      0x10000 + idx, Release));
+		used.fetch_sub(1, Relaxed);
+	    }
+
+	    size_t blockSize() const NOTHROW { return size; }
+	    size_t total() const NOTHROW { return count; }
+	    size_t inUse() const NOTHROW { return used.load(Relaxed); }
+
+	    // Returns the largest number of blocks that were ever
+	    // allocated at the same time.
+
+	    size_t highWaterMark() const NOTHROW
+	    {
+		return highWater.load(Relaxed);
+	    }
+	};
+
+	// BlockPool<> provides the storage for 'Count' blocks of at
+	// least 'Size' bytes. Each block starts on a cache line
+	// boundary and its size is rounded up to a multiple of the
+	// cache line size, so blocks never share a line. Count has
+	// to be less than 65535.
+
+	template <size_t Size, size_t Count>
+	class BlockPool : public BlockPoolBase {
+	    template <bool, int = 0> struct Valid { };
+	    template <int Dummy> struct Valid<true, Dummy> {
+		typedef Valid type;
+	    };
+
+	    typedef typename Valid<(Count > 0 && Count < 0xffff)>::type Check;
+
+	    enum {
+		BlockSize = (Size + VWPP_CACHE_LINE - 1) &
+			    ~(VWPP_CACHE_LINE - 1)
+	    };
+
+	    uint16_t links[Count];
+	    uint8_t blocks[BlockSize * Count]
+		__attribute__((aligned(VWPP_CACHE_LINE)));
+
+	 public:
+	    BlockPool() { _init(links, blocks, BlockSize, Count); }
+	};
+
+	// PoolPtr<> owns an object of type T which lives in a block
+	// of a BlockPool. The object is constructed when the PoolPtr
+	// is created and is destroyed, and its block returned to the
+	// pool, when the PoolPtr is destroyed. If the pool is empty,
+	// or its blocks are too small for T, the PoolPtr is empty;
+	// check it with valid() before using it. If T's constructor
+	// throws, the block goes back to the pool before the
+	// exception reaches the caller. Ownership can be passed to
+	// another PoolPtr by using release() and the adopting
+	// constructor (this is how a PoolPtr gets passed through a
+	// Queue.)
+
+	template <typename T>
+	class PoolPtr : private Uncopyable {
+	    BlockPoolBase* pool;
+	    T* ptr;
+
+	    T* alloc(BlockPoolBase& p) NOTHROW
+	    {
+		return sizeof(T) <= p.blockSize() ?
+		    static_cast<T*>(p.allocate()) : 0;
+	    }
+
+	 public:
+	    explicit PoolPtr(BlockPoolBase& p) : pool(&p), ptr(alloc(p))
+	    {
+		if (ptr)
+#if defined(__EXCEPTIONS)
+		    try {
+			new (ptr) T();
+		    }
+		    catch (...) {
+			p.deallocate(ptr);
+			throw;
+		    }
+#else
+		    new (ptr) T();
+#endif
+	    }
+
+	    PoolPtr(BlockPoolBase& p, T const& v) : pool(&p), ptr(alloc(p))
+	    {
+		if (ptr)
+#if defined(__EXCEPTIONS)
+		    try {
+			new (ptr) T(v);
+		    }
+		    catch (...) {
+			p.deallocate(ptr);
+			throw;
+		    }
+#else
+		    new (ptr) T(v);
+#endif
+	    }
+
+	    // Takes ownership of an object previously given up by
+	    // release().
+
+	    PoolPtr(BlockPoolBase& p, T* const o) NOTHROW : pool(&p), ptr(o) {}
+
+#if __cplusplus >= 201103L
+	    PoolPtr(PoolPtr&& o) NOTHROW : pool(o.pool), ptr(o.ptr)
+	    {
+		o.ptr = 0;
+	    }
+#endif
+
+	    ~PoolPtr() NOTHROW { reset(); }
+
+	    bool valid() const NOTHROW { return ptr != 0; }
+
+	    T* get() const NOTHROW { return ptr; }
+	    T* operator->() const NOTHROW { return ptr; }
+	    T& operator*() const NOTHROW { return *ptr; }
+
+	    // Gives up ownership of the object without destroying it.
+
+	    T* release() NOTHROW
+	    {
+		T* const tmp = ptr;
+
+		ptr = 0;
+		return tmp;
+	    }
+
+	    void reset() NOTHROW
+	    {
+		if (ptr) {
+		    ptr->~T();
+		    pool->deallocate(ptr);
+		    ptr = 0;
+		}
+	    }
+	};
+    };
+};
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
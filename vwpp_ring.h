@@ -0,0 +1,272 @@
+#if !defined(__VWPP_RING_H)
+#define __VWPP_RING_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+#include <cstring>
+
+namespace vwpp {
+    namespace v3_0 {
+
+	namespace VME {
+
+	    // A doorbell policy which does nothing. The consumer has
+	    // to poll the ring.
+
+	    struct NoDoorbell {
+		enum { Enabled = false };
+
+		void ring() const NOTHROW {}
+	    };
+
+	    // Writes a value to a mailbox register of the consumer's
+	    // VME bridge, which interrupts the consumer's CPU. The
+	    // consumer should connect an Interrupt<> to the mailbox
+	    // vector and wake the task draining the ring.
+
+	    class MailboxDoorbell {
+		uint32_t volatile* const reg;
+		uint32_t const value;
+
+	     public:
+		enum { Enabled = true };
+
+		MailboxDoorbell(AddressSpace const space, uint32_t const addr,
+				uint32_t const v = 1) :
+		    reg(reinterpret_cast<uint32_t volatile*>
+			(calcBaseAddr(space, addr))), value(v)
+		{}
+
+		void ring() const NOTHROW
+		{
+		    io_fence();
+		    *reg = value;
+		    io_fence();
+		    *reg;
+		}
+	    };
+
+	    // SharedRing<> is a single-producer, single-consumer queue
+	    // of 'N' entries which lives in memory shared by two CPU
+	    // boards, usually A32 memory on one of them. Each board
+	    // creates its own SharedRing object on the agreed address;
+	    // one of them pushes, the other pops. The producer owns
+	    // the head index and the consumer owns the tail index, so
+	    // no read-modify-write cycles cross the bus.
+	    //
+	    // Entries are copied as 32-bit words so the ring works
+	    // through D32-only windows. T should be a plain structure
+	    // (no pointers -- the boards don't share an address
+	    // space.) The memory has to be mapped uncached, or cached
+	    // with snooping, on both boards. The ring doesn't convert
+	    // byte order.
+	    //
+	    // The ring only depends on a base address so it can also
+	    // be placed in any other memory shared between two
+	    // processors or processes.
+
+	    template <typename T, size_t N, typename Doorbell = NoDoorbell>
+	    class SharedRing : private Uncopyable, private NoHeap {
+		template <bool, int = 0> struct Valid { };
+		template <int Dummy> struct Valid<true, Dummy> {
+		    typedef Valid type;
+		};
+
+		typedef typename Valid<(N > 0 && (N & (N - 1)) == 0)>::type
+		Check;
+
+		// The layout of the shared memory. The offsets are
+		// fixed, rather than based on VWPP_CACHE_LINE, because
+		// both boards have to agree on them.
+
+		enum {
+		    Words = (sizeof(T) + 3) / 4,
+		    MagicOffset = 0, EntriesOffset = 4, WordsOffset = 8,
+		    HeadOffset = 64, TailOffset = 128, DataOffset = 192,
+		    Magic = 0x56525247
+		};
+
+		uint8_t volatile* const base;
+		Doorbell const bell;
+
+		// Each side's copy of the other side's index. It only
+		// gets refreshed when the ring looks full (producer)
+		// or empty (consumer), which saves a bus read most of
+		// the time.
+
+		uint32_t headCache;
+		uint32_t tailCache;
+
+		uint32_t volatile& word(size_t const offset) const NOTHROW
+		{
+		    return *reinterpret_cast<uint32_t volatile*>(base + offset);
+		}
+
+		uint32_t volatile* slot(uint32_t const idx) const NOTHROW
+		{
+		    return &word(DataOffset + (idx % N) * Words * 4);
+		}
+
+	     public:
+		// The number of bytes of shared memory the ring needs.
+
+		enum { Bytes = DataOffset + N * Words * 4 };
+
+		SharedRing(AddressSpace const space, uint32_t const addr,
+			   Doorbell const& d = Doorbell()) :
+		    base(calcBaseAddr(space, addr)), bell(d), headCache(0),
+		    tailCache(0)
+		{}
+
+		SharedRing(uint8_t volatile* const b,
+			   Doorbell const& d = Doorbell()) :
+		    base(b), bell(d), headCache(0), tailCache(0)
+		{}
+
+		// Empties the ring and marks it as initialized. Exactly
+		// one side (usually the producer) should call this,
+		// before the other side starts using the ring.
+
+		void init() NOTHROW
+		{
+		    word(MagicOffset) = 0;
+		    full_fence();
+		    word(HeadOffset) = 0;
+		    word(TailOffset) = 0;
+		    word(EntriesOffset) = N;
+		    word(WordsOffset) = Words;
+		    headCache = tailCache = 0;
+		    store_fence();
+		    word(MagicOffset) = Magic;
+		    full_fence();
+		}
+
+		// Returns true if the other side initialized the ring
+		// with the same configuration. The side that didn't
+		// call init() should wait for this before using the
+		// ring.
+
+		bool ready() NOTHROW
+		{
+		    if (word(MagicOffset) != Magic)
+			return false;
+		    load_fence();
+		    if (word(EntriesOffset) != N || word(WordsOffset) != Words)
+			return false;
+		    headCache = word(HeadOffset);
+		    tailCache = word(TailOffset);
+		    load_fence();
+		    return true;
+		}
+
+		// Adds an entry. Returns false if the ring is full.
+		// Only the producer may call this.
+
+		bool try_push(T const& v) NOTHROW
+		{
+		    uint32_t const head = headCache;
+
+		    if (head - tailCache >= N) {
+			tailCache = word(TailOffset);
+
+			// The slot can't be written before the consumer
+			// is seen to be done with it.
+
+			load_fence();
+			if (head - tailCache >= N)
+			    return false;
+		    }
+
+		    uint32_t tmp[Words];
+		    uint32_t volatile* const dst = slot(head);
+
+		    tmp[Words - 1] = 0;
+		    memcpy(tmp, &v, sizeof(T));
+		    for (size_t ii = 0; ii < Words; ++ii)
+			dst[ii] = tmp[ii];
+
+		    // The entry has to reach memory before the new
+		    // head index does.
+
+		    store_fence();
+		    word(HeadOffset) = headCache = head + 1;
+
+		    // The consumer only needs waking if it had emptied
+		    // the ring. The cached tail may be stale so it has
+		    // to be read again, after the head is visible (the
+		    // consumer does the mirror image of this in
+		    // try_pop().)
+
+		    if (Doorbell::Enabled) {
+			full_fence();
+			tailCache = word(TailOffset);
+			if (head == tailCache)
+			    bell.ring();
+		    }
+		    return true;
+		}
+
+		// Removes the oldest entry. Returns false if the ring is
+		// empty. Only the consumer may call this.
+
+		bool try_pop(T& v) NOTHROW
+		{
+		    uint32_t const tail = tailCache;
+
+		    if (headCache == tail) {
+			// Our last tail update has to be visible before
+			// we look at the head, or the producer could
+			// decide not to ring while we decide to sleep.
+
+			full_fence();
+			headCache = word(HeadOffset);
+
+			// Don't let the entry be read before the head
+			// index.
+
+			load_fence();
+			if (headCache == tail)
+			    return false;
+		    }
+
+		    uint32_t tmp[Words];
+		    uint32_t volatile const* const src = slot(tail);
+
+		    for (size_t ii = 0; ii < Words; ++ii)
+			tmp[ii] = src[ii];
+		    memcpy(&v, tmp, sizeof(T));
+
+		    // The entry has to be read before the producer
+		    // can reuse the slot.
+
+		    load_fence();
+		    word(TailOffset) = tailCache = tail + 1;
+		    return true;
+		}
+
+		// Returns the number of entries in the ring. The value
+		// may be stale by the time it's used.
+
+		size_t size() const NOTHROW
+		{
+		    uint32_t const head = word(HeadOffset);
+
+		    load_fence();
+		    return head - word(TailOffset);
+		}
+
+		static size_t capacity() NOTHROW { return N; }
+	    };
+	};
+    };
+};
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
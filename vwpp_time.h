@@ -0,0 +1,159 @@
+#if !defined(__VWPP_TIME_H)
+#define __VWPP_TIME_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// Converts time base counts to nanoseconds (or microseconds.)
+	// The first call may calibrate the time base (see
+	// timebase_hz()), so these shouldn't be used by interrupt
+	// handlers until a task has called one of them.
+
+	uint64_t counts_to_ns(uint64_t);
+	uint64_t counts_to_us(uint64_t);
+
+	// A Timestamp is a reading of the 64-bit time base. It doesn't
+	// wrap (for centuries) so time stamps taken far apart can be
+	// compared and subtracted. Taking one is safe at interrupt
+	// level.
+
+	class Timestamp {
+	    uint64_t value;
+
+	    explicit Timestamp(uint64_t const v) : value(v) {}
+
+	 public:
+	    Timestamp() : value(0) {}
+
+	    static Timestamp now() NOTHROW
+	    {
+		return Timestamp(read_timebase64());
+	    }
+
+	    uint64_t counts() const NOTHROW { return value; }
+
+	    // The time since the time base started (usually when the
+	    // board booted.)
+
+	    uint64_t ns() const { return counts_to_ns(value); }
+	    uint64_t us() const { return counts_to_us(value); }
+
+	    // The time from 'earlier' to this time stamp.
+
+	    uint64_t ns_since(Timestamp const& earlier) const
+	    {
+		return counts_to_ns(value - earlier.value);
+	    }
+
+	    uint64_t us_since(Timestamp const& earlier) const
+	    {
+		return counts_to_us(value - earlier.value);
+	    }
+
+	    bool operator<(Timestamp const& o) const NOTHROW
+	    {
+		return value < o.value;
+	    }
+
+	    bool operator==(Timestamp const& o) const NOTHROW
+	    {
+		return value == o.value;
+	    }
+	};
+
+	// A Histogram collects durations, measured in time base
+	// counts, in power-of-two buckets: bucket 'n' holds the
+	// durations from 2^(n-1) up to 2^n - 1 counts. Recording a
+	// duration takes a few atomic increments and no division, so
+	// it can be done in time-critical code and interrupt
+	// handlers. The percentiles are reported as the upper bound
+	// of the bucket they fall in; the maximum is exact.
+	//
+	// Each histogram is registered, under its name, while it
+	// exists so vwppHistShow() can print all of them.
+
+	class Histogram : private Uncopyable, private NoHeap {
+	 public:
+	    enum { Buckets = 33 };
+
+	 private:
+	    char const* const label;
+	    Histogram* next;
+	    Atomic<uint32_t> bucket[Buckets];
+	    Atomic<uint32_t> total;
+	    Atomic<uint32_t> worst;
+
+	 public:
+	    explicit Histogram(char const*);
+	    ~Histogram() NOTHROW;
+
+	    void record(uint32_t const counts) NOTHROW
+	    {
+		bucket[counts ? 32 - __builtin_clz(counts) : 0]
+		    .fetch_add(1, Relaxed);
+		total.fetch_add(1, Relaxed);
+
+		uint32_t w = worst.load(Relaxed);
+
+		while (counts > w &&
+		       !worst.compare_exchange(w, counts, Relaxed))
+		    ;
+	    }
+
+	    char const* name() const NOTHROW { return label; }
+	    uint32_t samples() const NOTHROW { return total.load(Relaxed); }
+	    uint64_t maxNs() const { return counts_to_ns(worst.load(Relaxed)); }
+
+	    // Returns the duration, in nanoseconds, that 'ppm' parts
+	    // per million of the samples didn't exceed.
+
+	    uint64_t percentileNs(uint32_t) const;
+
+	    void reset() NOTHROW;
+
+	    // Prints the statistics and the non-empty buckets. show()
+	    // must be called by a task.
+
+	    void show() const;
+	    static void showAll();
+	};
+
+	// A ScopedTimer records the time it existed in a Histogram.
+	// It uses the lower half of the time base, so it can measure
+	// durations of up to a couple of minutes.
+	//
+	//    void Driver::readout()
+	//    {
+	//        ScopedTimer t(readoutTime);
+	//        ...
+	//    }
+
+	class ScopedTimer : private Uncopyable, private NoHeap {
+	    Histogram& hist;
+	    uint32_t const start;
+
+	 public:
+	    explicit ScopedTimer(Histogram& h) NOTHROW :
+		hist(h), start(read_timebase())
+	    {}
+
+	    ~ScopedTimer() NOTHROW { hist.record(read_timebase() - start); }
+	};
+    };
+};
+
+extern "C" {
+    STATUS vwppHistShow();
+}
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
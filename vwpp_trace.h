@@ -0,0 +1,56 @@
+#if !defined(__VWPP_TRACE_H)
+#define __VWPP_TRACE_H
+
+#ifdef __BUILDING_VWPP
+#include "./vwpp.h"
+#else
+#include <vwpp-3.0.h>
+#endif
+
+namespace vwpp {
+    namespace v3_0 {
+
+	// The trace recorder logs what the vwpp primitives do: time
+	// spent acquiring semaphores and waiting on events and
+	// queues, semaphore releases, event wake-ups and the lifetime
+	// of tasks created by the Task class. Each task records into
+	// its own preallocated buffer, so recording needs no locks;
+	// interrupt handlers share one buffer. When a buffer fills,
+	// its oldest events are overwritten.
+	//
+	// exportChrome() writes the buffers in the Chrome trace event
+	// (JSON) format, which can be loaded into chrome://tracing or
+	// the Perfetto UI. Time stamps are relative to start() and
+	// wrap when the 32-bit time base does. Stop the recorder
+	// before exporting.
+
+	class Trace : private Uncopyable {
+	    Trace();
+
+	 public:
+	    enum { MaxTasks = 64, BufferSize = 512 };
+
+	    static void start() NOTHROW;
+	    static void stop() NOTHROW;
+
+	    static void exportChrome(int fd);
+
+	    // Returns the number of events lost because more than
+	    // 'MaxTasks' tasks were recording.
+
+	    static uint32_t dropped() NOTHROW;
+	};
+    };
+};
+
+extern "C" {
+    STATUS vwppTraceStart();
+    STATUS vwppTraceStop();
+    STATUS vwppTraceExport(char const*);
+}
+
+#endif
+
+// Local Variables:
+// mode:c++
+// End:
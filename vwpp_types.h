@@ -10,6 +10,11 @@
 #define UNLIKELY(x)	__builtin_expect(!!(x), 0)
 
 #include <stdexcept>
+#include <new>
+
+#if __cplusplus >= 201103L
+#include <utility>
+#endif
 
 // The throw() specification should actually produce *more* code
 // (because the compiler needs to wrap the function with a try/catch
@@ -26,6 +31,21 @@
 #define NOTHROW_IMPL	throw()
 #endif
 
+// Modules built with exceptions disabled (-fno-exceptions) can't
+// compile 'throw' expressions, even in inline functions they never
+// call. The headers use VWPP_THROW() to report errors so they can
+// still be included by these modules. Without exception support,
+// an error that would have been thrown terminates the task. These
+// modules should use the non-throwing, Status-returning variants of
+// the blocking operations.
+
+#if defined(__EXCEPTIONS)
+#define VWPP_THROW(e)	throw e
+#else
+#include <cstdlib>
+#define VWPP_THROW(e)	::abort()
+#endif
+
 namespace vwpp {
     namespace v3_0 {
 